@@ -2,19 +2,230 @@
 #include "Server.h"
 #include "TcpConnection.h"
 #include "HttpContext.h"
+#include "HttpPipeline.h"
+#include "FileCache.h"
+#include "ResponseCache.h"
+#include "ComputePool.h"
+#include "Util.h"
+#include <dirent.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <sys/stat.h>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <string_view>
 
 using namespace std;
 
+const string kRootDir = "Resource"; // relative to the working directory, like HttpData's ROOT_DIR
+const string kUploadDir = "Upload"; // PUT /upload/<name> stores the body here
+const string_view kUploadPrefix = "/upload/";
+const size_t kMaxUploadSize = 1024 * 1024 * 1024; // larger uploads are answered with 413 before any byte is stored
+
+ComputePool* computePool = nullptr; // runs handlers that would block an I/O loop
+
+// Per-connection state: the request parser and the queue keeping responses in order
+struct HttpSession
+{
+    HttpContext context{HttpContext::kView};
+    shared_ptr<HttpPipeline> pipeline;
+    bool rejected = false; // an error response is queued, the connection shuts down after it
+};
+
+// Builds the response for a regular file under kRootDir, returns false if there is none
+bool serveFile(string_view requestPath, HttpPipeline::Response& response)
+{
+    string path;
+    if (!decodeUrlPath(requestPath, path) || path.find("..") != string::npos)
+    {
+        return false;
+    }
+    // hot files cost one cache lookup instead of realpath/open/fstat/close
+    FileCache::EntryPtr entry = FileCache::instance().lookup(kRootDir + path);
+    if (!entry || !entry->file)
+    {
+        return false;
+    }
+
+    response.header += "Connection: Keep-Alive\r\n";
+
+    // small files are served from prebuilt bytes shared by all loops, large ones with sendfile
+    ResponseCache& responseCache = ResponseCache::instance();
+    if (responseCache.cacheable(*entry))
+    {
+        ResponseCache::ResponsePtr cached = responseCache.lookup(*entry);
+        if (!cached)
+        {
+            cached = responseCache.insert(*entry);
+        }
+        if (cached)
+        {
+            response.body = cached->data;
+            return true;
+        }
+    }
+
+    // the headers a cached entry would carry, so both paths answer alike
+    response.header += ResponseCache::entityHeaders(ResponseCache::mimeType(entry->resolvedPath), entry->st.st_size);
+    response.file = entry->file;
+    response.len = entry->st.st_size;
+    return true;
+}
+
+string errorResponse(HttpContext::ParseError error)
+{
+    switch (error)
+    {
+    case HttpContext::kUriTooLong:
+        return "HTTP/1.1 414 URI Too Long\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+    case HttpContext::kHeaderTooLarge:
+        return "HTTP/1.1 431 Request Header Fields Too Large\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+    case HttpContext::kBodyTooLarge:
+        return "HTTP/1.1 413 Content Too Large\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+    case HttpContext::kNotImplemented:
+        return "HTTP/1.1 501 Not Implemented\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+    default:
+        return "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+    }
+}
+
+HttpPipeline::Response handleRequest(const HttpContext& context)
+{
+    HttpPipeline::Response response;
+    response.header = "HTTP/1.1 200 OK\r\n";
+    string content;
+    if (context.method() == HttpContext::kPost || context.method() == HttpContext::kPut)
+    {
+        // large bodies were already passed to the body callback and are not kept
+        content = "<p>Received " + to_string(context.bodyBytes()) + " bytes" + (context.bodyStreamed() ? " (streamed)" : "") + "</p>";
+    }
+    else if (serveFile(context.pathView(), response))
+    {
+        return response;
+    }
+
+    // header and body go out in one writev without being concatenated
+    response.body = make_shared<const string>("<html><body><h1>Hello from WebServer</h1><p>Path: " + string(context.pathView()) + "</p>" + content + "</body></html>");
+    response.header += "Content-Type: text/html\r\n";
+    response.header += "Content-Length: " + to_string(response.body->size()) + "\r\n";
+    response.header += "Connection: Keep-Alive\r\n";
+    response.header += "\r\n";
+    return response;
+}
+
+// Directory listing for a path ending in '/'. Runs on the compute pool: readdir and stat
+// may wait for the disk, which would stall every connection of the loop.
+HttpPipeline::Response listDirectory(const string& requestPath)
+{
+    HttpPipeline::Response response;
+    string path;
+    bool valid = decodeUrlPath(requestPath, path) && path.find("..") == string::npos;
+    string dirPath = kRootDir + path;
+    DIR* dir = valid ? opendir(dirPath.c_str()) : nullptr;
+    if (!dir)
+    {
+        response.header = "HTTP/1.1 404 Not Found\r\nConnection: Keep-Alive\r\nContent-Length: 0\r\n\r\n";
+        return response;
+    }
+
+    string body = "<html><body><h1>Directory Listing</h1><ul>";
+    while (struct dirent* entry = readdir(dir))
+    {
+        string name = entry->d_name;
+        if (name == "." || name == "..")
+        {
+            continue;
+        }
+        struct stat st;
+        if (stat((dirPath + name).c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            name += "/";
+        }
+        // names come from the filesystem and the path from the request, neither is trusted markup
+        body += "<li><a href=\"" + escapeHtml(encodeUrlPath(path + name)) + "\">" + escapeHtml(name) + "</a></li>";
+    }
+    closedir(dir);
+    body += "</ul></body></html>";
+
+    response.header = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: " + to_string(body.size()) + "\r\nConnection: Keep-Alive\r\n\r\n";
+    response.body = make_shared<const string>(std::move(body));
+    return response;
+}
+
+// Name of the upload target for PUT /upload/<name>, empty if the path is not one
+string_view uploadName(const HttpContext& context)
+{
+    string_view path = context.pathView();
+    if (context.method() != HttpContext::kPut || path.substr(0, kUploadPrefix.size()) != kUploadPrefix)
+    {
+        return string_view();
+    }
+    string_view name = path.substr(kUploadPrefix.size());
+    if (name.empty() || name.find('/') != string_view::npos || name.find("..") != string_view::npos)
+    {
+        return string_view();
+    }
+    return name;
+}
+
+// Streams the body of an upload request from the socket into kUploadDir; the response
+// is sent once the whole body is on disk. Returns false if the upload was refused, in
+// which case the unread body is still on its way and the connection cannot be reused
+bool handleUpload(const shared_ptr<TcpConnection>& conn, HttpSession* session, const HttpContext& context)
+{
+    uint64_t seq = session->pipeline->reserve();
+    shared_ptr<HttpPipeline> pipeline = session->pipeline;
+    HttpPipeline::Response refused;
+    refused.close = true;
+    if (context.contentLength() > kMaxUploadSize)
+    {
+        refused.header = errorResponse(HttpContext::kBodyTooLarge);
+        pipeline->complete(seq, std::move(refused));
+        return false;
+    }
+
+    string target = kUploadDir + "/" + string(uploadName(context));
+    int fd = open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        perror("open upload");
+        refused.header = "HTTP/1.1 500 Internal Server Error\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+        pipeline->complete(seq, std::move(refused));
+        return false;
+    }
+
+    auto file = make_shared<const OpenFile>(fd);
+    conn->receiveToFile(file, 0, context.contentLength(), [pipeline, seq](const shared_ptr<TcpConnection>&, size_t received, bool ok) {
+        HttpPipeline::Response response;
+        if (ok)
+        {
+            string body = "Stored " + to_string(received) + " bytes\n";
+            response.header = "HTTP/1.1 201 Created\r\nContent-Length: " + to_string(body.size()) + "\r\n\r\n" + body;
+        }
+        else
+        {
+            response.header = "HTTP/1.1 500 Internal Server Error\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+            response.close = true;
+        }
+        pipeline->complete(seq, std::move(response));
+    });
+    return true;
+}
+
 void onConnection(const shared_ptr<TcpConnection>& conn)
 {
     if (conn->connected())
     {
-        cout << "New connection " << conn->name() << " from " << conn->fd() << endl;
-        conn->setContext(HttpContext());
+        cout << "New connection " << conn->name() << " from " << conn->peerAddress().toIpPort() << endl;
+        // requests are parsed in place, the handler only sees views into the input buffer
+        HttpSession session;
+        session.pipeline = make_shared<HttpPipeline>(conn);
+        // bodies over the inline limit arrive here piece by piece; the demo only reports their size
+        session.context.setBodyCallback([](const HttpContext&, string_view) {});
+        // upload bodies bypass the parser and go from the socket to disk with splice
+        session.context.setBodyHandoff([](const HttpContext& context) { return !uploadName(context).empty(); });
+        conn->setContext(session);
     }
     else
     {
@@ -24,49 +235,110 @@ void onConnection(const shared_ptr<TcpConnection>& conn)
 
 void onMessage(const shared_ptr<TcpConnection>& conn, Buffer* buf)
 {
-    HttpContext* context = std::any_cast<HttpContext>(conn->getMutableContext());
-    
-    // Parse the request
-    // Note: Receive time is not passed in this callback, utilizing 0 or now
-    if (!context->parseRequest(buf, 0))
-    {
-        // If parsing fails (and it's not partial), send error
-        // But parseRequest returns false for partial too? 
-        // Need to check HttpContext impl. 
-        // Assuming false means "need more data" or "error" is handled internally?
-        // Let's assume false means "not done yet" or "error handled"
-        // Wait, if it's an error, parseRequest usually returns false AND sets state to error?
-        // Let's assume it just needs more data for now.
-        conn->send("HTTP/1.1 400 Bad Request\r\n\r\n");
-        conn->shutdown();
+    HttpSession* session = std::any_cast<HttpSession>(conn->getMutableContext());
+    HttpContext& context = session->context;
+    if (session->rejected)
+    {
+        buf->retrieveAll();
         return;
     }
 
-    if (context->gotAll())
+    // Handle every complete request in the buffer, pipelined ones included; the
+    // pipeline sends the responses in request order however they complete
+    // Note: Receive time is not passed in this callback, utilizing 0 or now
+    while (true)
     {
-        cout << "Request: " << context->method() << " " << context->path() << endl;
-        
-        string body = "<html><body><h1>Hello from WebServer</h1><p>Path: " + context->path() + "</p></body></html>";
-        string response = "HTTP/1.1 200 OK\r\n";
-        response += "Content-Type: text/html\r\n";
-        response += "Content-Length: " + to_string(body.size()) + "\r\n";
-        response += "Connection: Keep-Alive\r\n";
-        response += "\r\n";
-        response += body;
+        if (!context.parseRequest(buf, 0))
+        {
+            // Malformed or over a parser limit; an incomplete request just waits for more data.
+            // Nothing after a bad request can be framed, so whatever the peer sends until the
+            // connection is shut down after the error response is dropped unread
+            buf->retrieveAll();
+            session->rejected = true;
+            HttpPipeline::Response response;
+            response.header = errorResponse(context.error());
+            response.close = true;
+            session->pipeline->complete(session->pipeline->reserve(), std::move(response));
+            return;
+        }
+        if (!context.gotAll())
+        {
+            return;
+        }
+
+        cout << "Request: " << context.method() << " " << context.pathView() << endl;
+        if (context.bodyHandedOff())
+        {
+            if (!handleUpload(conn, session, context))
+            {
+                // the refused body would otherwise be parsed as the next request
+                context.consume(buf);
+                buf->retrieveAll();
+                session->rejected = true;
+                return;
+            }
+        }
+        else if (context.method() == HttpContext::kGet && !context.pathView().empty() && context.pathView().back() == '/')
+        {
+            // listed on the compute pool; the response is sent from this loop once it is built
+            uint64_t seq = session->pipeline->reserve();
+            shared_ptr<HttpPipeline> pipeline = session->pipeline;
+            string path(context.pathView()); // the view does not survive consume()
+            computePool->submit(
+                conn->getLoop(),
+                [path]() { return listDirectory(path); },
+                [pipeline, seq](HttpPipeline::Response response) { pipeline->complete(seq, std::move(response)); });
+        }
+        else
+        {
+            uint64_t seq = session->pipeline->reserve();
+            session->pipeline->complete(seq, handleRequest(context));
+        }
+
+        // Release the request bytes and reset context for the next request
+        context.consume(buf);
+        if (conn->receivingToFile() || !conn->connected())
+        {
+            return; // the next request starts after the body still on its way
+        }
+    }
+}
 
-        conn->send(response);
-        
-        // Simple keep-alive handling: always keep alive unless requested otherwise
-        // For now, reset context for next request
-        context->reset();
+EventLoopThreadPool::SelectionPolicy selectionPolicy(const string& name)
+{
+    if (name == "conn")
+    {
+        return EventLoopThreadPool::kLeastConnections;
+    }
+    if (name == "pending")
+    {
+        return EventLoopThreadPool::kLeastPending;
+    }
+    if (name == "latency")
+    {
+        return EventLoopThreadPool::kLeastLatency;
     }
+    if (name == "hash")
+    {
+        return EventLoopThreadPool::kConsistentHash;
+    }
+    if (name == "cpu")
+    {
+        return EventLoopThreadPool::kIncomingCpu;
+    }
+    return EventLoopThreadPool::kRoundRobin;
 }
 
 int main(int argc, char* argv[])
 {
     int threadNum = 4;
     int port = 8080;
-    const char* optString = "t:p:";
+    bool useIoUring = false;
+    bool reusePort = false;
+    bool pinThreads = false;
+    int computeThreads = 2;
+    EventLoopThreadPool::SelectionPolicy policy = EventLoopThreadPool::kRoundRobin;
+    const char* optString = "t:p:urb:aw:";
     int opt;
 
     while ((opt = getopt(argc, argv, optString)) != -1)
@@ -79,17 +351,43 @@ int main(int argc, char* argv[])
         case 'p':
             port = atoi(optarg);
             break;
+        case 'u':
+            useIoUring = true;
+            break;
+        case 'r':
+            reusePort = true;
+            break;
+        case 'b':
+            policy = selectionPolicy(optarg);
+            break;
+        case 'a':
+            pinThreads = true;
+            break;
+        case 'w':
+            computeThreads = atoi(optarg);
+            break;
         default:
             break;
         }
     }
 
-    EventLoop loop;
-    Server server(&loop, threadNum, port);
+    mkdir(kUploadDir.c_str(), 0755);
+
+    EventLoop loop(useIoUring ? EventLoop::kIoUring : EventLoop::kEpoll);
+    Server server(&loop, threadNum, port, reusePort);
+    server.setSelectionPolicy(policy);
+    if (pinThreads)
+    {
+        server.setCpuAffinity(EventLoopThreadPool::cpuPerLoop()); // one core per I/O thread
+    }
     
     server.setConnectionCallback(onConnection);
     server.setMessageCallback(onMessage);
 
+    // declared after the server, so queued work finishes while the loops still exist
+    ComputePool pool(computeThreads);
+    computePool = &pool;
+
     server.start();
     loop.loop();
     
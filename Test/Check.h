@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdio>
+
+// Minimal assertion helpers for the unit tests. A failed CHECK reports its
+// location and the test keeps going; main() returns testResult().
+inline int& checkFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(cond)                                                                  \
+    do                                                                               \
+    {                                                                                \
+        if (!(cond))                                                                 \
+        {                                                                            \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ++checkFailures();                                                       \
+        }                                                                            \
+    } while (0)
+
+#define CHECK_EQ(a, b) CHECK((a) == (b))
+
+inline int testResult()
+{
+    if (checkFailures() > 0)
+    {
+        fprintf(stderr, "%d check(s) failed\n", checkFailures());
+        return 1;
+    }
+    return 0;
+}
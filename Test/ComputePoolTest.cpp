@@ -0,0 +1,97 @@
+#include "Check.h"
+#include "ComputePool.h"
+#include "EventLoop.h"
+#include <atomic>
+#include <set>
+#include <string>
+#include <thread>
+
+// Every submitted task runs once; the destructor waits for the ones still queued.
+void testSubmit()
+{
+    std::atomic<int> runs(0);
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    {
+        ComputePool pool(4);
+        CHECK_EQ(pool.threadCount(), 4u);
+        for (int i = 0; i < 1000; ++i)
+        {
+            pool.submit([&]() {
+                runs.fetch_add(1);
+                std::lock_guard<std::mutex> lock(mutex);
+                threads.insert(std::this_thread::get_id());
+            });
+        }
+    }
+    CHECK_EQ(runs.load(), 1000);
+    CHECK(threads.count(std::this_thread::get_id()) == 0);
+}
+
+// Tasks submitted by a running task are queued on its worker, stolen by the others, and
+// still finished before the destructor returns.
+void testNestedSubmit()
+{
+    std::atomic<int> runs(0);
+    {
+        ComputePool pool(3);
+        for (int i = 0; i < 10; ++i)
+        {
+            pool.submit([&]() {
+                for (int j = 0; j < 100; ++j)
+                {
+                    pool.submit([&]() { runs.fetch_add(1); });
+                }
+            });
+        }
+    }
+    CHECK_EQ(runs.load(), 1000);
+}
+
+// work runs on the pool, done gets its result in the loop thread.
+void testComplete()
+{
+    EventLoop loop;
+    ComputePool pool(2);
+    const int kRequests = 20;
+    int completed = 0;
+    bool inLoop = true;
+    bool offLoop = true;
+    bool resultsMatch = true;
+
+    for (int i = 0; i < kRequests; ++i)
+    {
+        pool.submit(
+            &loop,
+            [&offLoop, &loop, i]() {
+                if (loop.isInLoopThread())
+                {
+                    offLoop = false;
+                }
+                return std::to_string(i * i);
+            },
+            [&, i](std::string result) {
+                inLoop = inLoop && loop.isInLoopThread();
+                resultsMatch = resultsMatch && result == std::to_string(i * i);
+                if (++completed == kRequests)
+                {
+                    loop.quit();
+                }
+            });
+    }
+    loop.runAfter(5.0, [&loop]() { loop.quit(); }); // a safety net should a completion go missing
+    loop.loop();
+
+    CHECK_EQ(completed, kRequests);
+    CHECK(inLoop);
+    CHECK(offLoop);
+    CHECK(resultsMatch);
+}
+
+int main()
+{
+    testSubmit();
+    testNestedSubmit();
+    testComplete();
+    return testResult();
+}
@@ -0,0 +1,112 @@
+#include "Check.h"
+#include "ConnectionRegistry.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+#include <fcntl.h>
+#include <set>
+#include <vector>
+
+using ConnectionPtr = ConnectionRegistry::ConnectionPtr;
+
+// Never established, so it only needs an fd to close.
+ConnectionPtr makeConnection(EventLoop* loop, uint64_t id)
+{
+    return TcpConnection::create(loop, id, open("/dev/null", O_RDONLY | O_CLOEXEC), InetAddress());
+}
+
+// Ids of the registered connections; checks every stored index points back at its slot.
+std::vector<uint64_t> registered(const ConnectionRegistry& registry)
+{
+    std::vector<uint64_t> ids;
+    registry.forEach([&ids](const ConnectionPtr& conn) {
+        CHECK_EQ(conn->registryIndex(), ids.size());
+        ids.push_back(conn->id());
+    });
+    return ids;
+}
+
+// Removing swaps the last connection into the hole and updates its index.
+void testSwapRemove(EventLoop* loop)
+{
+    ConnectionRegistry registry(loop);
+    std::vector<ConnectionPtr> conns;
+    for (uint64_t id = 1; id <= 5; ++id)
+    {
+        conns.push_back(makeConnection(loop, id));
+        registry.add(conns.back());
+    }
+    CHECK_EQ(registry.size(), 5u);
+    CHECK(registered(registry) == std::vector<uint64_t>({1, 2, 3, 4, 5}));
+
+    registry.remove(conns[1]); // 5 moves into slot 1
+    CHECK(registered(registry) == std::vector<uint64_t>({1, 5, 3, 4}));
+    CHECK_EQ(conns[4]->registryIndex(), 1u);
+
+    registry.remove(conns[3]); // the last one, nothing moves
+    CHECK(registered(registry) == std::vector<uint64_t>({1, 5, 3}));
+
+    registry.remove(conns[0]);
+    CHECK(registered(registry) == std::vector<uint64_t>({3, 5}));
+    CHECK_EQ(registry.size(), 2u);
+
+    // removing twice, or a connection that was never added, changes nothing
+    registry.remove(conns[0]);
+    registry.remove(conns[1]);
+    ConnectionPtr stranger = makeConnection(loop, 6);
+    registry.remove(stranger);
+    CHECK(registered(registry) == std::vector<uint64_t>({3, 5}));
+}
+
+// takeAll() hands every connection over and leaves the registry empty; a later remove()
+// of one of them is a no-op.
+void testTakeAll(EventLoop* loop)
+{
+    ConnectionRegistry registry(loop);
+    std::vector<ConnectionPtr> conns;
+    for (uint64_t id = 1; id <= 3; ++id)
+    {
+        conns.push_back(makeConnection(loop, id));
+        registry.add(conns.back());
+    }
+
+    std::vector<ConnectionPtr> taken = registry.takeAll();
+    CHECK_EQ(taken.size(), 3u);
+    CHECK_EQ(registry.size(), 0u);
+    CHECK(registered(registry).empty());
+
+    registry.remove(conns[2]);
+    CHECK_EQ(registry.size(), 0u);
+
+    // the registry is usable again afterwards
+    registry.add(conns[0]);
+    CHECK(registered(registry) == std::vector<uint64_t>({1}));
+}
+
+// A visitor may remove connections while the registry is being walked.
+void testRemoveWhileVisiting(EventLoop* loop)
+{
+    ConnectionRegistry registry(loop);
+    std::vector<ConnectionPtr> conns;
+    for (uint64_t id = 1; id <= 4; ++id)
+    {
+        conns.push_back(makeConnection(loop, id));
+        registry.add(conns.back());
+    }
+
+    std::set<uint64_t> visited;
+    registry.forEach([&](const ConnectionPtr& conn) {
+        visited.insert(conn->id());
+        registry.remove(conn);
+    });
+    CHECK_EQ(visited.size(), 4u);
+    CHECK_EQ(registry.size(), 0u);
+}
+
+int main()
+{
+    EventLoop loop;
+    testSwapRemove(&loop);
+    testTakeAll(&loop);
+    testRemoveWhileVisiting(&loop);
+    return testResult();
+}
@@ -0,0 +1,234 @@
+#include "Check.h"
+#include "HttpContext.h"
+#include <string>
+
+// Feeds the whole request in one go and returns what parseRequest() said.
+bool parseAll(HttpContext& context, Buffer& buf, const std::string& request)
+{
+    buf.append(request);
+    return context.parseRequest(&buf, 0);
+}
+
+// A complete request parses, whether it arrives at once or a byte at a time.
+void testComplete()
+{
+    const std::string request = "GET /index.html?x=1 HTTP/1.1\r\nHost: a\r\nAccept: */*\r\n\r\n";
+    {
+        HttpContext context;
+        Buffer buf;
+        CHECK(parseAll(context, buf, request));
+        CHECK(context.gotAll());
+        CHECK_EQ(context.method(), HttpContext::kGet);
+        CHECK_EQ(context.path(), "/index.html");
+        CHECK_EQ(context.query(), "x=1");
+        CHECK_EQ(context.getHeader("Host"), "a");
+        CHECK_EQ(buf.readableBytes(), 0u);
+    }
+    {
+        HttpContext context;
+        Buffer buf;
+        for (char c : request)
+        {
+            CHECK(!context.gotAll());
+            buf.append(&c, 1);
+            CHECK(context.parseRequest(&buf, 0));
+        }
+        CHECK(context.gotAll());
+        CHECK_EQ(context.headers().size(), 2u);
+    }
+}
+
+// A request line over kMaxRequestLine is a 414, even before its CRLF arrives.
+void testUriTooLong()
+{
+    HttpContext context;
+    Buffer buf;
+    std::string line = "GET /" + std::string(HttpContext::kMaxRequestLine, 'a');
+    CHECK(!parseAll(context, buf, line));
+    CHECK_EQ(context.error(), HttpContext::kUriTooLong);
+
+    // the error is terminal until reset()
+    CHECK(!context.parseRequest(&buf, 0));
+    context.reset();
+    buf.retrieveAll();
+    CHECK(parseAll(context, buf, "GET / HTTP/1.1\r\n\r\n"));
+    CHECK(context.gotAll());
+}
+
+// An oversized header line, header block or header count is a 431.
+void testHeaderTooLarge()
+{
+    {
+        HttpContext context;
+        Buffer buf;
+        std::string request = "GET / HTTP/1.1\r\nX: " + std::string(HttpContext::kMaxHeaderLine, 'v');
+        CHECK(!parseAll(context, buf, request));
+        CHECK_EQ(context.error(), HttpContext::kHeaderTooLarge);
+    }
+    {
+        HttpContext context;
+        Buffer buf;
+        std::string request = "GET / HTTP/1.1\r\n";
+        std::string header = "X: " + std::string(HttpContext::kMaxHeaderLine / 2, 'v') + "\r\n";
+        while (request.size() < HttpContext::kMaxHeaderBytes + header.size())
+        {
+            request += header;
+        }
+        CHECK(!parseAll(context, buf, request));
+        CHECK_EQ(context.error(), HttpContext::kHeaderTooLarge);
+    }
+    {
+        HttpContext context;
+        Buffer buf;
+        std::string request = "GET / HTTP/1.1\r\n";
+        for (size_t i = 0; i <= HttpContext::kMaxHeaders; ++i)
+        {
+            request += "X" + std::to_string(i) + ": v\r\n";
+        }
+        CHECK(!parseAll(context, buf, request));
+        CHECK_EQ(context.error(), HttpContext::kHeaderTooLarge);
+    }
+}
+
+// Malformed request lines and header lines without a colon are a 400.
+void testBadRequest()
+{
+    const char* requests[] = {
+        "BREW / HTTP/1.1\r\n\r\n",
+        "GET / HTTP/2.0\r\n\r\n",
+        "GET / HTTP/1.1\r\nno colon here\r\n\r\n",
+    };
+    for (const char* request : requests)
+    {
+        HttpContext context;
+        Buffer buf;
+        CHECK(!parseAll(context, buf, request));
+        CHECK_EQ(context.error(), HttpContext::kBadRequest);
+    }
+}
+
+// A Content-Length body is collected in both modes, also when it arrives piece by piece.
+void testContentLength()
+{
+    for (HttpContext::ParseMode mode : {HttpContext::kCopy, HttpContext::kView})
+    {
+        HttpContext context(mode);
+        Buffer buf;
+        CHECK(parseAll(context, buf, "POST /x HTTP/1.1\r\nContent-Length: 10\r\n\r\nhello"));
+        CHECK(!context.gotAll());
+        CHECK(parseAll(context, buf, "world"));
+        CHECK(context.gotAll());
+        CHECK_EQ(context.body(), "helloworld");
+    }
+}
+
+// Chunks are decoded, chunk extensions and trailer fields are skipped.
+void testChunked()
+{
+    const std::string request = "POST /x HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                                "5;ext=1\r\nhello\r\nA\r\n, chunked!\r\n0\r\nX-Trailer: t\r\n\r\n"
+                                "GET /next HTTP/1.1\r\n\r\n";
+    for (HttpContext::ParseMode mode : {HttpContext::kCopy, HttpContext::kView})
+    {
+        HttpContext context(mode);
+        Buffer buf;
+        for (char c : request)
+        {
+            buf.append(&c, 1);
+            CHECK(context.parseRequest(&buf, 0));
+            if (context.gotAll())
+            {
+                break;
+            }
+        }
+        CHECK(context.gotAll());
+        CHECK_EQ(context.body(), "hello, chunked!");
+        CHECK_EQ(context.bodyBytes(), 15u);
+
+        // the pipelined request behind the body parses on its own
+        context.consume(&buf);
+        buf.append(request.substr(request.find("GET")));
+        CHECK(context.parseRequest(&buf, 0));
+        CHECK(context.gotAll());
+        CHECK(context.pathView() == "/next");
+    }
+
+    const char* malformed[] = {
+        "POST /x HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+        "POST /x HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabcX\r\n",
+    };
+    for (const char* request : malformed)
+    {
+        HttpContext context;
+        Buffer buf;
+        CHECK(!parseAll(context, buf, request));
+        CHECK_EQ(context.error(), HttpContext::kBadRequest);
+    }
+}
+
+// Ambiguous framing is a 400: differing or empty Content-Length fields, or one next
+// to Transfer-Encoding. Identical repeated values are fine.
+void testContentLengthConflicts()
+{
+    const char* rejected[] = {
+        "POST /x HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 4\r\n\r\nabcd",
+        "POST /x HTTP/1.1\r\nContent-Length: 3\r\ncontent-length: 4\r\n\r\nabcd",
+        "POST /x HTTP/1.1\r\nContent-Length:\r\n\r\n",
+        "POST /x HTTP/1.1\r\nContent-Length: +3\r\n\r\nabc",
+        "POST /x HTTP/1.1\r\nContent-Length: 3\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n0\r\n\r\n",
+    };
+    for (HttpContext::ParseMode mode : {HttpContext::kCopy, HttpContext::kView})
+    {
+        for (const char* request : rejected)
+        {
+            HttpContext context(mode);
+            Buffer buf;
+            CHECK(!parseAll(context, buf, request));
+            CHECK_EQ(context.error(), HttpContext::kBadRequest);
+        }
+
+        HttpContext context(mode);
+        Buffer buf;
+        CHECK(parseAll(context, buf, "POST /x HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 3\r\n\r\nabc"));
+        CHECK(context.gotAll());
+        CHECK_EQ(context.body(), "abc");
+    }
+}
+
+// A body over maxBodySize() is a 413, in either framing; a coding other than chunked is a 501.
+void testBodyLimits()
+{
+    {
+        HttpContext context;
+        context.setMaxBodySize(8);
+        Buffer buf;
+        CHECK(!parseAll(context, buf, "POST /x HTTP/1.1\r\nContent-Length: 9\r\n\r\n"));
+        CHECK_EQ(context.error(), HttpContext::kBodyTooLarge);
+    }
+    {
+        HttpContext context;
+        context.setMaxBodySize(8);
+        Buffer buf;
+        CHECK(!parseAll(context, buf, "POST /x HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n5\r\nworld\r\n"));
+        CHECK_EQ(context.error(), HttpContext::kBodyTooLarge);
+    }
+    {
+        HttpContext context;
+        Buffer buf;
+        CHECK(!parseAll(context, buf, "POST /x HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n"));
+        CHECK_EQ(context.error(), HttpContext::kNotImplemented);
+    }
+}
+
+int main()
+{
+    testComplete();
+    testUriTooLong();
+    testHeaderTooLarge();
+    testBadRequest();
+    testContentLength();
+    testChunked();
+    testContentLengthConflicts();
+    testBodyLimits();
+    return testResult();
+}
@@ -0,0 +1,120 @@
+#include "Check.h"
+#include "HttpPipeline.h"
+#include "TcpConnection.h"
+#include <fcntl.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+// A connection on one end of a socketpair; the test reads what it sends from the other.
+struct Peer
+{
+    std::shared_ptr<TcpConnection> conn;
+    int fd = -1;
+
+    explicit Peer(EventLoop* loop)
+    {
+        int fds[2];
+        socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds);
+        conn = TcpConnection::create(loop, 1, fds[0], InetAddress());
+        conn->connectEstablished();
+        fd = fds[1];
+    }
+    ~Peer()
+    {
+        conn->connectDestroyed();
+        close(fd);
+    }
+
+    // Everything sent so far; eof is set once the connection has been shut down.
+    std::string received(bool* eof = nullptr)
+    {
+        std::string data;
+        char buf[256];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof buf)) > 0)
+        {
+            data.append(buf, n);
+        }
+        if (eof)
+        {
+            *eof = (n == 0);
+        }
+        return data;
+    }
+};
+
+HttpPipeline::Response response(const std::string& text, bool close = false)
+{
+    HttpPipeline::Response r;
+    r.header = text;
+    r.close = close;
+    return r;
+}
+
+// Responses go out in request order, whatever order they complete in.
+void testOrdering(EventLoop* loop)
+{
+    Peer peer(loop);
+    auto pipeline = std::make_shared<HttpPipeline>(peer.conn);
+    uint64_t first = pipeline->reserve();
+    uint64_t second = pipeline->reserve();
+    uint64_t third = pipeline->reserve();
+    CHECK_EQ(pipeline->pending(), 3u);
+
+    pipeline->complete(third, response("C"));
+    pipeline->complete(second, response("B"));
+    CHECK_EQ(peer.received(), "");
+    CHECK_EQ(pipeline->pending(), 3u);
+
+    pipeline->complete(first, response("A"));
+    CHECK_EQ(peer.received(), "ABC");
+    CHECK_EQ(pipeline->pending(), 0u);
+}
+
+// A response completed on another thread is queued to the loop and still keeps its place.
+void testCrossThread(EventLoop* loop)
+{
+    Peer peer(loop);
+    auto pipeline = std::make_shared<HttpPipeline>(peer.conn);
+    uint64_t first = pipeline->reserve();
+    uint64_t second = pipeline->reserve();
+
+    std::thread worker([&]() { pipeline->complete(first, response("A")); });
+    worker.join();
+    pipeline->complete(second, response("B"));
+    CHECK_EQ(peer.received(), "");
+
+    loop->runAfter(0.05, [loop]() { loop->quit(); });
+    loop->loop();
+    CHECK_EQ(peer.received(), "AB");
+}
+
+// A close response shuts the connection down once it is out; later ones are dropped.
+void testClose(EventLoop* loop)
+{
+    Peer peer(loop);
+    auto pipeline = std::make_shared<HttpPipeline>(peer.conn);
+    uint64_t first = pipeline->reserve();
+    uint64_t second = pipeline->reserve();
+    uint64_t third = pipeline->reserve();
+
+    pipeline->complete(third, response("C"));
+    pipeline->complete(second, response("B", true));
+    pipeline->complete(first, response("A"));
+
+    bool eof = false;
+    CHECK_EQ(peer.received(&eof), "AB");
+    CHECK(eof);
+    CHECK_EQ(pipeline->pending(), 0u);
+}
+
+int main()
+{
+    EventLoop loop;
+    testOrdering(&loop);
+    testCrossThread(&loop);
+    testClose(&loop);
+    return testResult();
+}
@@ -0,0 +1,104 @@
+#include "Check.h"
+#include "MpscQueue.h"
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Elements come out in the order they were pushed.
+void testFifo()
+{
+    MpscQueue<int> queue;
+    int value = -1;
+    CHECK(!queue.pop(value));
+
+    for (int i = 0; i < 10; ++i)
+    {
+        queue.push(i);
+    }
+    for (int i = 0; i < 10; ++i)
+    {
+        CHECK(queue.pop(value));
+        CHECK_EQ(value, i);
+    }
+    CHECK(!queue.pop(value));
+
+    // the stub node is recycled once the queue drains, so it must keep working
+    queue.push(42);
+    CHECK(queue.pop(value));
+    CHECK_EQ(value, 42);
+    CHECK(!queue.pop(value));
+}
+
+// Move-only values pass through, and anything left is destroyed with the queue.
+void testMoveOnly()
+{
+    std::shared_ptr<int> counter = std::make_shared<int>(0);
+    {
+        MpscQueue<std::shared_ptr<int>> queue;
+        queue.push(counter);
+        queue.push(counter);
+        std::shared_ptr<int> out;
+        CHECK(queue.pop(out));
+        CHECK(out == counter);
+        out.reset();
+        CHECK_EQ(counter.use_count(), 2);
+    }
+    CHECK_EQ(counter.use_count(), 1);
+}
+
+// Concurrent producers: nothing is lost or duplicated, and each producer's
+// elements keep their relative order.
+void testProducers()
+{
+    const int kProducers = 4;
+    const int kPerProducer = 100000;
+    MpscQueue<int> queue;
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; ++p)
+    {
+        producers.emplace_back([&queue, p]() {
+            for (int i = 0; i < kPerProducer; ++i)
+            {
+                queue.push(p * kPerProducer + i);
+            }
+        });
+    }
+
+    std::vector<int> next(kProducers, 0);
+    int received = 0;
+    bool ordered = true;
+    while (received < kProducers * kPerProducer)
+    {
+        int value;
+        if (!queue.pop(value))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        int p = value / kPerProducer;
+        ordered = ordered && value % kPerProducer == next[p];
+        ++next[p];
+        ++received;
+    }
+    for (std::thread& t : producers)
+    {
+        t.join();
+    }
+
+    CHECK(ordered);
+    for (int p = 0; p < kProducers; ++p)
+    {
+        CHECK_EQ(next[p], kPerProducer);
+    }
+    int value;
+    CHECK(!queue.pop(value));
+}
+
+int main()
+{
+    testFifo();
+    testMoveOnly();
+    testProducers();
+    return testResult();
+}
@@ -0,0 +1,104 @@
+#include "Check.h"
+#include "EventLoop.h"
+#include <chrono>
+#include <thread>
+
+using namespace std::chrono;
+
+// Runs the loop for the given time.
+void runFor(EventLoop* loop, double seconds)
+{
+    loop->runAfter(seconds, [loop]() { loop->quit(); });
+    loop->loop();
+}
+
+// A cancelled timer never runs, whichever thread cancels it; a stale handle is ignored.
+void testCancel(EventLoop* loop)
+{
+    int fired = 0;
+    TimerId once = loop->runAfter(0.02, [&]() { ++fired; });
+    TimerId other = loop->runAfter(0.02, [&]() { ++fired; });
+    CHECK(once.valid());
+    loop->cancel(once);
+    std::thread([loop, other]() { loop->cancel(other); }).join();
+    runFor(loop, 0.08);
+    CHECK_EQ(fired, 0);
+
+    TimerId stale = loop->runAfter(0.01, [&]() { ++fired; });
+    runFor(loop, 0.05);
+    CHECK_EQ(fired, 1);
+    loop->cancel(stale); // already ran
+    loop->cancel(TimerId());
+    runFor(loop, 0.02);
+    CHECK_EQ(fired, 1);
+}
+
+// Cancelling a timer from an earlier callback of the same expired batch still stops it.
+void testCancelWithinBatch(EventLoop* loop)
+{
+    int fired = 0;
+    TimerId second;
+    steady_clock::time_point start = steady_clock::now();
+    // holds the loop up until both timers below are due, so they expire in one batch
+    loop->runAt(start + milliseconds(10), []() { std::this_thread::sleep_for(milliseconds(30)); });
+    loop->runAt(start + milliseconds(15), [&]() { loop->cancel(second); });
+    second = loop->runAt(start + milliseconds(20), [&]() { ++fired; });
+    runFor(loop, 0.08);
+    CHECK_EQ(fired, 0);
+}
+
+// A repeating timer can cancel itself from its own callback.
+void testRepeatingSelfCancel(EventLoop* loop)
+{
+    int ticks = 0;
+    TimerId repeating;
+    repeating = loop->runEvery(0.01, [&]() {
+        if (++ticks == 3)
+        {
+            loop->cancel(repeating);
+        }
+    });
+    runFor(loop, 0.1);
+    CHECK_EQ(ticks, 3);
+}
+
+// Restarting moves the expiration from now, so a timer that keeps being restarted
+// fires only once the restarts stop.
+void testRestart(EventLoop* loop)
+{
+    int fired = 0;
+    steady_clock::time_point start = steady_clock::now();
+    steady_clock::time_point firedAt;
+    TimerId timer = loop->runAfter(0.03, [&]() {
+        ++fired;
+        firedAt = steady_clock::now();
+    });
+    int restarts = 0;
+    TimerId pusher;
+    pusher = loop->runEvery(0.01, [&]() {
+        loop->restart(timer, 0.03);
+        if (++restarts == 5)
+        {
+            loop->cancel(pusher);
+        }
+    });
+    runFor(loop, 0.2);
+    CHECK_EQ(restarts, 5);
+    CHECK_EQ(fired, 1);
+    CHECK(firedAt - start >= milliseconds(80)); // the last restart was at about 50 ms
+
+    // restarting a timer that already ran does nothing
+    loop->restart(timer, 0.01);
+    runFor(loop, 0.03);
+    CHECK_EQ(fired, 1);
+}
+
+int main()
+{
+    EventLoop loop;
+    testCancel(&loop);
+    testCancelWithinBatch(&loop);
+    testRepeatingSelfCancel(&loop);
+    testRestart(&loop);
+    return testResult();
+}
@@ -0,0 +1,91 @@
+#include "Check.h"
+#include "EventLoop.h"
+#include "TimingWheel.h"
+#include <chrono>
+#include <memory>
+#include <vector>
+
+using namespace std::chrono;
+using Ms = TimingWheel::Duration;
+
+// Runs the loop for the given time.
+void runFor(EventLoop* loop, double seconds)
+{
+    loop->runAfter(seconds, [loop]() { loop->quit(); });
+    loop->loop();
+}
+
+// Entries fire in deadline order and never early, including ones that start on an outer
+// level (over 256 ticks away) and are cascaded inward as the wheel turns.
+void testCascade(EventLoop* loop)
+{
+    TimingWheel wheel(loop, Ms(1));
+    const Ms timeouts[] = {Ms(700), Ms(5), Ms(300), Ms(40)};
+    std::vector<Ms> fired;
+    std::vector<bool> early;
+    std::vector<std::unique_ptr<TimingWheel::Entry>> entries;
+
+    steady_clock::time_point start = steady_clock::now();
+    for (Ms timeout : timeouts)
+    {
+        entries.push_back(std::make_unique<TimingWheel::Entry>([&, timeout]() {
+            fired.push_back(timeout);
+            early.push_back(steady_clock::now() - start < timeout);
+        }));
+        wheel.schedule(entries.back().get(), timeout);
+    }
+    CHECK_EQ(wheel.size(), 4u);
+
+    runFor(loop, 0.9);
+    CHECK_EQ(fired.size(), 4u);
+    CHECK(fired == std::vector<Ms>({Ms(5), Ms(40), Ms(300), Ms(700)}));
+    CHECK(early == std::vector<bool>(4, false));
+    CHECK_EQ(wheel.size(), 0u);
+    for (const auto& entry : entries)
+    {
+        CHECK(!entry->scheduled());
+    }
+}
+
+// Cancelled and destroyed entries never fire; scheduling a pending entry moves it.
+void testCancel(EventLoop* loop)
+{
+    TimingWheel wheel(loop, Ms(1));
+    int cancelled = 0;
+    int refreshed = 0;
+    steady_clock::time_point refreshedAt;
+
+    TimingWheel::Entry cancelEntry([&]() { ++cancelled; });
+    wheel.schedule(&cancelEntry, Ms(20));
+    wheel.cancel(&cancelEntry);
+    CHECK(!cancelEntry.scheduled());
+    wheel.cancel(&cancelEntry); // cancelling twice is harmless
+
+    {
+        TimingWheel::Entry gone([&]() { ++cancelled; });
+        wheel.schedule(&gone, Ms(300));
+    }
+    CHECK_EQ(wheel.size(), 0u);
+
+    TimingWheel::Entry refreshEntry([&]() {
+        ++refreshed;
+        refreshedAt = steady_clock::now();
+    });
+    steady_clock::time_point start = steady_clock::now();
+    wheel.schedule(&refreshEntry, Ms(20));
+    wheel.schedule(&refreshEntry, Ms(400)); // moved out, past the first root revolution
+    CHECK_EQ(wheel.size(), 1u);
+
+    runFor(loop, 0.6);
+    CHECK_EQ(cancelled, 0);
+    CHECK_EQ(refreshed, 1);
+    CHECK(refreshedAt - start >= Ms(400));
+}
+
+int main()
+{
+    EventLoop loop;
+    testCascade(&loop);
+    testCancel(&loop);
+    return testResult();
+}
@@ -85,7 +85,6 @@ int main(int argc, char* argv[])
         return 2;
     }
     int options_index = 0;
-    size_t colonPos = 0;
     int opt = 0;
     while ((opt = getopt_long(argc, argv, "912Vfrt:p:c:?hk", long_options, &options_index)) !=
            EOF)
@@ -502,7 +501,7 @@ void benchcore(const std::string& host, int port, const std::string& request)
 {
     // setup alarm signal handler
     struct sigaction sa;
-    sa.sa_handler = [](int signal)
+    sa.sa_handler = [](int)
     { timeout = 1; };
     sigemptyset(&sa.sa_mask);
     sa.sa_flags = 0;
@@ -616,7 +615,7 @@ void benchcore(const std::string& host, int port, const std::string& request)
             }
 
             if (send(socket, request.c_str(), request.length(), 0) !=
-                request.length()) // failed to send request to server
+                static_cast<ssize_t>(request.length())) // failed to send request to server
             {
                 failed++;
                 close(socket);
@@ -2,32 +2,41 @@
 
 #include "EventLoop.h"
 #include "Channel.h"
+#include "InetAddress.h"
 #include <functional>
 
 class Acceptor
 {
 public:
-    using NewConnectionCallback = std::function<void(int sockfd, const InetAddress&)>; // InetAddress not defined yet, use struct sockaddr_in?
+    using NewConnectionCallback = std::function<void(int sockfd, const InetAddress&)>;
 
-    Acceptor(EventLoop* loop, int port);
+    Acceptor(EventLoop* loop, int port, bool reusePort = false);
     ~Acceptor();
 
     void setNewConnectionCallback(const NewConnectionCallback& cb) { newConnectionCallback_ = cb; }
+    // reusePort: the kernel prefers the listener of the group whose CPU matches the one that
+    // received the connection, keeping it on the core that handles its RX queue. Before listen().
+    void setIncomingCpu(int cpu);
     void listen();
     bool listening() const { return listening_; }
+    EventLoop* getLoop() const { return loop_; }
 
 private:
+    // upper bound of connections taken per readiness event, so one busy listener cannot starve the loop
+    static const int kMaxAcceptsPerRead = 64;
+    // pause of the listener when out of fds with no reserve fd left to shed a connection with
+    static constexpr double kBackoffSeconds = 0.1;
+
     void handleRead();
+    // Returns false if there was no reserve fd and the listener was paused instead
+    bool dropPendingConnection();
+    void resumeAfterBackoff();
 
     EventLoop* loop_;
     int acceptSocket_;
     Channel acceptChannel_;
     NewConnectionCallback newConnectionCallback_;
     bool listening_;
-};
-
-// Simple InetAddress struct for now
-struct InetAddress
-{
-    // Placeholder
+    int idleFd_; // reserve fd, given up on EMFILE to accept and close a pending connection
+    TimerId backoffTimer_; // valid while the listener is paused after running out of fds
 };
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "SlabPool.h"
 #include <vector>
 #include <string>
 #include <algorithm>
@@ -11,8 +12,10 @@ public:
     static const size_t kCheapPrepend = 8;
     static const size_t kInitialSize = 1024;
 
-    explicit Buffer(size_t initialSize = kInitialSize)
-        : buffer_(kCheapPrepend + initialSize),
+    using Allocator = PoolAllocator<char>;
+
+    explicit Buffer(size_t initialSize = kInitialSize, const Allocator& alloc = Allocator())
+        : buffer_(kCheapPrepend + initialSize, alloc),
           readerIndex_(kCheapPrepend),
           writerIndex_(kCheapPrepend)
     {
@@ -106,7 +109,7 @@ private:
         }
     }
 
-    std::vector<char> buffer_;
+    std::vector<char, Allocator> buffer_;
     size_t readerIndex_;
     size_t writerIndex_;
 };
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+// Delimiter search for the HTTP parsers. The SSE2/AVX2 or scalar implementation
+// is picked once at startup from the CPU's features.
+
+// First "\r\n" in [begin, end), or end if there is none
+const char* findCRLF(const char* begin, const char* end);
+
+// First occurrence of c in [begin, end), or end if there is none
+const char* findChar(const char* begin, const char* end, char c);
+
+// "avx2", "sse2" or "scalar"
+const char* charScanImplementation();
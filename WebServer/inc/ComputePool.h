@@ -0,0 +1,65 @@
+#pragma once
+
+#include "EventLoop.h"
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Work-stealing thread pool for handler work too slow for an I/O loop: directory listings,
+// compression, rendering. Each worker owns a deque; tasks submitted from outside are spread
+// over the workers, a task submitted from inside a worker stays on that worker's deque, and
+// a worker that runs dry steals the oldest task of another. Loops stay free to dispatch
+// events while the work scales across cores.
+class ComputePool
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit ComputePool(int numThreads);
+    // Runs the tasks already submitted, then joins the workers
+    ~ComputePool();
+
+    ComputePool(const ComputePool&) = delete;
+    ComputePool& operator=(const ComputePool&) = delete;
+
+    void submit(Task task);
+
+    // Runs work on the pool and done(result) in loop afterwards, the place to send the
+    // response from. Both are copied into std::function, so they must be copyable.
+    template <typename Work, typename Done>
+    void submit(EventLoop* loop, Work work, Done done)
+    {
+        submit([loop, work, done]() mutable {
+            auto result = work();
+            loop->runInLoop([done, result = std::move(result)]() mutable { done(std::move(result)); });
+        });
+    }
+
+    size_t threadCount() const { return workers_.size(); }
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks; // the owner works at the back, thieves take from the front
+        std::thread thread;
+    };
+
+    void workerFunc(size_t index);
+    bool take(size_t index, Task& task);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<size_t> nextWorker_;
+    std::atomic<int64_t> pending_; // tasks in the deques; briefly negative when a task is taken before its submit() counted it
+    std::atomic<size_t> sleepers_; // submit() only takes sleepMutex_ to wake one of them
+    std::mutex sleepMutex_;
+    std::condition_variable sleepCond_;
+    bool stopping_; // guarded by sleepMutex_
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class EventLoop;
+class TcpConnection;
+
+// Connections served by one I/O loop, kept in a dense array: a connection's index is
+// stored in it, so adding and removing are O(1) without any lookup, and iterating walks
+// contiguous memory. Owned by the Server, used from the loop thread only except size().
+class ConnectionRegistry
+{
+public:
+    using ConnectionPtr = std::shared_ptr<TcpConnection>;
+    using Visitor = std::function<void(const ConnectionPtr&)>;
+
+    explicit ConnectionRegistry(EventLoop* loop);
+
+    ConnectionRegistry(const ConnectionRegistry&) = delete;
+    ConnectionRegistry& operator=(const ConnectionRegistry&) = delete;
+
+    EventLoop* getLoop() const { return loop_; }
+
+    void add(const ConnectionPtr& conn);
+    void remove(const ConnectionPtr& conn);
+    void forEach(const Visitor& visitor) const;
+    // Empties the registry and hands its connections to the caller, for shutdown
+    std::vector<ConnectionPtr> takeAll();
+
+    // Safe from any thread, for stats
+    size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+private:
+    EventLoop* loop_;
+    std::vector<ConnectionPtr> connections_;
+    std::atomic<size_t> size_;
+};
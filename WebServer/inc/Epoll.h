@@ -1,29 +1,36 @@
 #pragma once
 
+#include "Poller.h"
 #include <sys/epoll.h>
 #include <vector>
 #include <memory>
 
 class Channel;
 
-class Epoll
+class Epoll : public Poller
 {
 public:
     Epoll();
-    ~Epoll();
+    ~Epoll() override;
 
     // Non-copyable
     Epoll(const Epoll&) = delete;
     Epoll& operator=(const Epoll&) = delete;
 
-    void updateChannel(Channel* channel);
-    void removeChannel(Channel* channel);
+    void updateChannel(Channel* channel) override;
+    void removeChannel(Channel* channel) override;
+    bool hasChannel(Channel* channel) const override;
 
-    std::vector<Channel*> poll(int timeoutMs);
+    void poll(int timeoutMs, ChannelList* activeChannels) override;
 
 private:
     static const int kInitEventListSize = 16;
+    // events_ is halved after this many consecutive polls that used less than a quarter of it
+    static const int kShrinkAfterPolls = 1024;
+
+    void adjustEventList(int numEvents);
 
     int epollFd_;
     std::vector<struct epoll_event> events_;
+    int underusedPolls_;
 };
@@ -1,23 +1,33 @@
 #pragma once
 
+#include "MpscQueue.h"
+#include "TimerId.h"
 #include <functional>
 #include <vector>
 #include <memory>
-#include <mutex>
 #include <thread>
 #include <atomic>
 #include <chrono>
 
-class Epoll;
+class Poller;
 class Channel;
 class TimerManager;
+class TimingWheel;
+class SlabPool;
 
 class EventLoop
 {
 public:
     using Functor = std::function<void()>;
 
-    EventLoop();
+    enum PollerType
+    {
+        kEpoll,
+        kIoUring, // falls back to kEpoll when the kernel has no usable io_uring
+    };
+
+    // numaNode >= 0 places the loop's memory pool on that node, for a loop pinned to it
+    explicit EventLoop(PollerType pollerType = kEpoll, int numaNode = -1);
     ~EventLoop();
 
     EventLoop(const EventLoop&) = delete;
@@ -29,10 +39,17 @@ public:
     void runInLoop(Functor cb);
     void queueInLoop(Functor cb);
 
-    // Timers
-    void runAt(std::chrono::steady_clock::time_point time, std::function<void()> cb);
-    void runAfter(double delay, std::function<void()> cb);
-    void runEvery(double interval, std::function<void()> cb);
+    // Timers, safe to use from any thread
+    TimerId runAt(std::chrono::steady_clock::time_point time, std::function<void()> cb);
+    TimerId runAfter(double delay, std::function<void()> cb);
+    TimerId runEvery(double interval, std::function<void()> cb);
+    void cancel(TimerId timerId);
+    // Fires the timer delay seconds from now instead of at its current expiration
+    void restart(TimerId timerId, double delay);
+    // Coarse O(1) timeouts with intrusive entries, for per-connection deadlines
+    TimingWheel* timingWheel() { return timingWheel_.get(); }
+    // Recycles the memory of this loop's connections; allocate from the loop thread only
+    const std::shared_ptr<SlabPool>& pool() const { return pool_; }
 
     void wakeup();
     void updateChannel(Channel* channel);
@@ -40,8 +57,21 @@ public:
     bool hasChannel(Channel* channel);
 
     bool isInLoopThread() const { return threadId_ == std::this_thread::get_id(); }
+    // true once quit() was called, functors queued after that may never run
+    bool quitting() const { return quit_; }
     void assertInLoopThread();
 
+    PollerType pollerType() const { return pollerType_; }
+    int numaNode() const { return numaNode_; }
+
+    // Load counters, readable from any thread, for balancing connections across loops.
+    // Connections are counted by whoever assigns them to this loop, until they are removed.
+    int assignedConnections() const { return assignedConnections_.load(std::memory_order_relaxed); }
+    void adjustAssignedConnections(int delta) { assignedConnections_.fetch_add(delta, std::memory_order_relaxed); }
+    int pendingFunctorCount() const { return pendingFunctorCount_.load(std::memory_order_relaxed); }
+    // Moving average of the time one iteration spends handling events and functors
+    int64_t busyMicros() const { return busyMicros_.load(std::memory_order_relaxed); }
+
 private:
     void handleRead(); // Wakeup handler
     void doPendingFunctors();
@@ -54,14 +84,23 @@ private:
     std::atomic<bool> callingPendingFunctors_;
     
     const std::thread::id threadId_;
-    std::unique_ptr<Epoll> poller_;
+    PollerType pollerType_;
+    const int numaNode_;
+    std::unique_ptr<Poller> poller_;
     
     int wakeupFd_;
     std::unique_ptr<Channel> wakeupChannel_;
     std::unique_ptr<TimerManager> timerQueue_;
+    std::unique_ptr<TimingWheel> timingWheel_;
+    std::shared_ptr<SlabPool> pool_;
     
     ChannelList activeChannels_;
     
-    std::mutex mutex_;
-    std::vector<Functor> pendingFunctors_;
+    MpscQueue<Functor> pendingFunctors_;
+    std::vector<Functor> runningFunctors_; // batch drained from pendingFunctors_, capacity reused
+    std::atomic<bool> wakeupPending_;      // an eventfd write is in flight, further wakeup() calls can be skipped
+
+    std::atomic<int> assignedConnections_;
+    std::atomic<int> pendingFunctorCount_;
+    std::atomic<int64_t> busyMicros_;
 };
@@ -1,14 +1,18 @@
 #pragma once
+#include "EventLoop.h"
 #include <mutex>
 #include <condition_variable>
 #include <thread>
-
-class EventLoop;
+#include <vector>
 
 class EventLoopThread
 {
 public:
-    EventLoopThread();
+    using CpuSet = std::vector<int>;
+
+    // A non-empty cpus pins the thread to those CPUs before its loop is created; when they
+    // all sit on one NUMA node, the loop's memory pool is placed on that node too
+    explicit EventLoopThread(EventLoop::PollerType pollerType = EventLoop::kEpoll, const CpuSet& cpus = CpuSet());
     ~EventLoopThread();
     EventLoop* startLoop();
 
@@ -16,6 +20,8 @@ private:
     void threadFunc();
 
     EventLoop* loop_;
+    EventLoop::PollerType pollerType_;
+    const CpuSet cpus_;
     bool exiting_;
     std::thread thread_;
     std::mutex mutex_;
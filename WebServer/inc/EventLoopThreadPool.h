@@ -1,25 +1,74 @@
 #pragma once
 
+#include "EventLoopThread.h"
+#include <cstdint>
+#include <functional>
 #include <vector>
 #include <memory>
 
 class EventLoop;
-class EventLoopThread;
+class InetAddress;
 
 class EventLoopThreadPool
 {
 public:
+    // How getLoopForConnection() picks the loop for a new connection
+    enum SelectionPolicy
+    {
+        kRoundRobin,
+        kLeastConnections, // fewest assigned connections
+        kLeastPending,     // fewest queued functors, i.e. least work waiting to run
+        kLeastLatency,     // shortest recent iteration time; a loop without connections counts as idle
+        kConsistentHash,   // same peer IP, same loop; adding a loop moves only about 1/n of the clients
+        kIncomingCpu,      // the loop pinned to the CPU that received the connection (SO_INCOMING_CPU),
+                           // falling back to kLeastConnections when no loop runs there
+    };
+    // A custom policy; called in the base loop with the I/O loops and the new peer. A result
+    // that is not one of those loops is ignored and the connection goes round-robin
+    using LoopSelector = std::function<EventLoop*(const std::vector<EventLoop*>& loops, const InetAddress& peerAddr)>;
+
     EventLoopThreadPool(EventLoop* baseLoop, int numThreads);
     ~EventLoopThreadPool();
 
+    // Set before start(), or later from the base loop thread
+    void setSelectionPolicy(SelectionPolicy policy);
+    void setLoopSelector(const LoopSelector& selector) { selector_ = selector; }
+    // Loop i is pinned to cpus[i % cpus.size()]; empty leaves the threads unpinned
+    void setCpuAffinity(const std::vector<EventLoopThread::CpuSet>& cpus) { cpus_ = cpus; }
+    // Every CPU the process may run on as a set of its own, i.e. one core per loop
+    static std::vector<EventLoopThread::CpuSet> cpuPerLoop();
+
     void start();
     EventLoop* getNextLoop();
+    // Applies the selection policy to the accepted socket and counts the connection in the
+    // chosen loop's assignedConnections(); whoever removes the connection gives it back
+    EventLoop* getLoopForConnection(int sockfd, const InetAddress& peerAddr);
+    // The CPU the loop is pinned to, -1 unless it is pinned to exactly one
+    int pinnedCpu(EventLoop* loop) const;
+    // I/O loops, or the base loop alone when the pool has no threads
+    std::vector<EventLoop*> getAllLoops();
 
 private:
+    static const int kVirtualNodes = 64; // points per loop on the hash ring
+
+    // Scans the loops for the lowest score, starting after the last pick so ties rotate
+    template <typename Score>
+    EventLoop* leastLoaded(Score score);
+    EventLoop* hashedLoop(const InetAddress& peerAddr) const;
+    EventLoop* selectedLoop(const InetAddress& peerAddr);
+    void buildRing();
+    EventLoop* incomingCpuLoop(int sockfd) const;
+
     EventLoop* baseLoop_;
     bool started_;
     int numThreads_;
     int next_;
     std::vector<std::unique_ptr<EventLoopThread>> threads_;
     std::vector<EventLoop*> loops_;
+
+    SelectionPolicy policy_;
+    LoopSelector selector_;
+    std::vector<std::pair<uint64_t, EventLoop*>> ring_; // kConsistentHash, sorted by point
+    std::vector<EventLoopThread::CpuSet> cpus_;
+    std::vector<EventLoop*> cpuLoops_; // indexed by CPU: the loop pinned to it alone, if any
 };
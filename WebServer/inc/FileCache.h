@@ -0,0 +1,57 @@
+#pragma once
+
+#include "OutputQueue.h"
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+
+// Bounded LRU cache of resolved paths, stat metadata and open fds for static files,
+// shared by all loops. Entries expire after a short TTL, so a changed or replaced file
+// is picked up again without any inotify bookkeeping.
+class FileCache
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry
+    {
+        std::string resolvedPath; // realpath() of the requested path
+        struct stat st;
+        OutputQueue::File file; // open for regular files, null for directories
+        Clock::time_point expires;
+    };
+    using EntryPtr = std::shared_ptr<const Entry>;
+
+    static const size_t kDefaultMaxEntries = 1024;
+    static constexpr double kDefaultTtlSeconds = 2.0;
+
+    explicit FileCache(size_t maxEntries = kDefaultMaxEntries, double ttlSeconds = kDefaultTtlSeconds);
+
+    // Process-wide instance used by the static file handlers
+    static FileCache& instance();
+
+    // Returns nullptr (with errno set) if the path cannot be resolved or opened, or is
+    // neither a regular file nor a directory; never blocks on FIFOs or devices
+    EntryPtr lookup(const std::string& path);
+    void invalidate(const std::string& path);
+    void clear();
+
+private:
+    struct Slot
+    {
+        EntryPtr entry;
+        std::list<std::string>::iterator lruPos;
+    };
+
+    EntryPtr load(const std::string& path, Clock::time_point now);
+
+    const size_t maxEntries_;
+    const Clock::duration ttl_;
+    std::mutex mutex_;
+    std::list<std::string> lru_; // most recently used first
+    std::unordered_map<std::string, Slot> entries_;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "OpenFile.h"
+#include <memory>
+#include <sys/types.h>
+
+// Moves a fixed number of bytes from a socket into a file with splice(2) through a pipe,
+// so a large upload never passes through user space or the connection's input Buffer.
+// Reading from the socket is bounded by the free space in the pipe: when the disk falls
+// behind, the data stays in the socket and TCP flow control slows the client down.
+class FileReceiver
+{
+public:
+    FileReceiver(const std::shared_ptr<const OpenFile>& file, off_t offset, size_t len);
+    ~FileReceiver();
+
+    // Non-copyable
+    FileReceiver(const FileReceiver&) = delete;
+    FileReceiver& operator=(const FileReceiver&) = delete;
+
+    // Stores bytes that were already read from the socket; returns false on a write error
+    bool write(const char* data, size_t len);
+
+    // Moves what the socket has without blocking on it, at most kMaxBytesPerCall so one
+    // upload cannot starve the other connections of the loop. Returns like read(2): bytes
+    // moved to the file, 0 if the peer closed before sending everything, -1 with
+    // *savedErrno set otherwise (EAGAIN if nothing was available).
+    ssize_t receive(int sockfd, int* savedErrno);
+
+    size_t remaining() const { return socketRemaining_ + pipeBytes_; }
+    bool done() const { return remaining() == 0; }
+    size_t received() const { return total_ - remaining(); }
+
+private:
+    bool openPipe();
+    ssize_t receiveSplice(int sockfd, int* savedErrno);
+    ssize_t receiveCopy(int sockfd, int* savedErrno);
+
+    static const size_t kMaxBytesPerCall = 1024 * 1024;
+    static const int kPipeSize = 1024 * 1024; // requested, the kernel may grant less
+
+    std::shared_ptr<const OpenFile> file_;
+    loff_t offset_;
+    const size_t total_;
+    size_t socketRemaining_; // not yet read from the socket
+    size_t pipeBytes_;       // read from the socket, not yet in the file
+    size_t pipeCapacity_;
+    int pipeFds_[2];
+    bool useSplice_; // cleared if the file or socket does not support splice
+};
@@ -1,8 +1,12 @@
 #pragma once
 
 #include "Buffer.h"
+#include <functional>
 #include <map>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 class HttpContext
 {
@@ -11,8 +15,13 @@ public:
     {
         kExpectRequestLine,
         kExpectHeaders,
-        kExpectBody,
+        kExpectBody,       // Content-Length framed body
+        kExpectChunkSize,  // chunked body: size line of the next chunk
+        kExpectChunkData,
+        kExpectChunkEnd,   // CRLF after the chunk data
+        kExpectTrailers,   // trailer fields after the last chunk, up to the blank line
         kGotAll,
+        kError,
     };
 
     enum HttpMethod
@@ -25,48 +34,175 @@ public:
         kUnknown, kHttp10, kHttp11
     };
 
-    HttpContext()
-        : state_(kExpectRequestLine),
+    enum ParseError
+    {
+        kNoError,
+        kBadRequest,     // 400
+        kUriTooLong,     // 414, request line longer than kMaxRequestLine
+        kHeaderTooLarge, // 431, a header line, the header block or the header count over its limit
+        kBodyTooLarge,   // 413, body longer than maxBodySize()
+        kNotImplemented, // 501, a transfer coding other than chunked
+    };
+
+    static const size_t kMaxRequestLine = 8 * 1024;
+    static const size_t kMaxHeaderLine = 8 * 1024;
+    static const size_t kMaxHeaderBytes = 64 * 1024;
+    static const size_t kMaxHeaders = 100;
+    static const size_t kDefaultMaxBodySize = 8 * 1024 * 1024;
+    static const size_t kDefaultInlineBodyLimit = 64 * 1024;
+
+    enum ParseMode
+    {
+        kCopy, // path, query and headers are copied into strings and a map, the buffer is consumed while parsing
+        kView, // the request is kept in the Buffer and only referenced; call consume() once the handler is done
+    };
+
+    // Receives a large body piece by piece while it is parsed, see setBodyCallback()
+    using BodyCallback = std::function<void(const HttpContext&, std::string_view data)>;
+    // Decides whether the caller takes over a Content-Length body, see setBodyHandoff()
+    using BodyHandoff = std::function<bool(const HttpContext&)>;
+
+    explicit HttpContext(ParseMode mode = kCopy)
+        : mode_(mode),
+          detached_(false),
+          state_(kExpectRequestLine),
           method_(kInvalid),
-          version_(kUnknown)
+          version_(kUnknown),
+          error_(kNoError),
+          scanned_(0),
+          headerLines_(0),
+          headerBytes_(0),
+          maxBodySize_(kDefaultMaxBodySize),
+          inlineBodyLimit_(kDefaultInlineBodyLimit),
+          contentLength_(0),
+          lengthFields_(0),
+          lengthConflict_(false),
+          handedOff_(false),
+          bodyRemaining_(0),
+          bodyBytes_(0),
+          bodyInBuffer_(false),
+          streamBody_(false),
+          buf_(nullptr),
+          base_(nullptr),
+          parsed_(0)
     {
     }
 
-    // Returns true if parsing is done (got a full request)
+    // Returns false if the request is malformed or over a limit, see error(). Otherwise
+    // gotAll() tells whether it is complete; an incomplete request is resumed by the next
+    // call without rescanning the bytes already looked at.
     bool parseRequest(Buffer* buf, int64_t receiveTime);
 
     bool gotAll() const { return state_ == kGotAll; }
-    void reset()
-    {
-        state_ = kExpectRequestLine;
-        method_ = kInvalid;
-        version_ = kUnknown;
-        path_.clear();
-        query_.clear();
-        headers_.clear();
-    }
+    ParseError error() const { return error_; }
+    void reset();
+    // Finishes the current request: in kView mode its bytes are retrieved from buf,
+    // which invalidates every view handed out for it
+    void consume(Buffer* buf);
+
+    // Bodies over maxBodySize are rejected with kBodyTooLarge. Bodies up to inlineBodyLimit,
+    // and all bodies while no BodyCallback is set, are collected and returned by body();
+    // with a Content-Length in kView mode that is a view into the Buffer without a copy.
+    // Larger ones are handed to the callback as they arrive and never held in full.
+    void setMaxBodySize(size_t bytes) { maxBodySize_ = bytes; }
+    void setInlineBodyLimit(size_t bytes) { inlineBodyLimit_ = bytes; }
+    void setBodyCallback(BodyCallback cb) { bodyCallback_ = std::move(cb); }
+    // Asked once the headers of a request with a non-empty Content-Length body are parsed.
+    // Returning true hands the body to the caller: the headers are copied out of the
+    // Buffer, the request completes without its body, and the caller must take the next
+    // contentLength() bytes from the Buffer and the socket, e.g. with
+    // TcpConnection::receiveToFile(), before parsing the next request.
+    void setBodyHandoff(BodyHandoff cb) { bodyHandoff_ = std::move(cb); }
+    size_t maxBodySize() const { return maxBodySize_; }
+
+    ParseMode mode() const { return mode_; }
 
+    // kCopy mode only
     const std::string& path() const { return path_; }
     const std::string& query() const { return query_; }
     const std::map<std::string, std::string>& headers() const { return headers_; }
+    const std::string& getHeader(const std::string& key) const;
+
+    // Both modes; in kView mode the views point into the Buffer and stay valid until consume()
+    std::string_view pathView() const { return viewing() ? view(pathRange_) : std::string_view(path_); }
+    std::string_view queryView() const { return viewing() ? view(queryRange_) : std::string_view(query_); }
+    std::string_view headerView(std::string_view key) const; // field names compare case-insensitively
+    size_t headerCount() const { return viewing() ? headerRanges_.size() : headers_.size(); }
+
+    // Complete body once gotAll(); empty if there was none or it went to the BodyCallback
+    std::string_view body() const { return bodyInBuffer_ ? view(bodyRange_) : std::string_view(body_); }
+    bool bodyStreamed() const { return streamBody_; }
+    bool bodyHandedOff() const { return handedOff_; }
+    size_t contentLength() const { return contentLength_; } // 0 unless the body is Content-Length framed
+    size_t bodyBytes() const { return bodyBytes_; } // decoded body length, streamed or not
+
     HttpMethod method() const { return method_; }
     HttpVersion version() const { return version_; }
-    const std::string& getHeader(const std::string& key) const;
     
     // Setters used by parser
     void setMethod(HttpMethod m) { method_ = m; }
     void setVersion(HttpVersion v) { version_ = v; }
-    void setPath(const char* start, const char* end) { path_.assign(start, end); }
-    void setQuery(const char* start, const char* end) { query_.assign(start, end); }
+    void setPath(const char* start, const char* end);
+    void setQuery(const char* start, const char* end);
     void addHeader(const char* start, const char* colon, const char* end);
 
 private:
+    // Position relative to the Buffer's read pointer, which survives the Buffer growing or compacting
+    struct Range
+    {
+        size_t offset = 0;
+        size_t len = 0;
+    };
+
     bool processRequestLine(const char* begin, const char* end);
+    const char* findLineEnd(const char* start, const char* end); // nullptr if the line is incomplete
+    void advance(Buffer* buf, size_t len);
+    bool failIf(bool failed, ParseError error);
+    bool startBody(Buffer* buf);
+    bool parseChunkSize(const char* start, const char* end);
+    void deliverBody(Buffer* buf, const char* data, size_t len);
+    void detachFromBuffer(Buffer* buf);
+    // views into the Buffer are in use; false in kCopy mode and once a streamed body forced a detach
+    bool viewing() const { return mode_ == kView && !detached_; }
+    Range toRange(const char* start, const char* end) const { return Range{static_cast<size_t>(start - base_), static_cast<size_t>(end - start)}; }
+    std::string_view view(const Range& r) const { return buf_ ? std::string_view(buf_->peek() + r.offset, r.len) : std::string_view(); }
 
+    ParseMode mode_;
+    bool detached_;
     HttpRequestParseState state_;
     HttpMethod method_;
     HttpVersion version_;
+    ParseError error_;
+
+    size_t scanned_;     // bytes of the current line already searched for CRLF
+    size_t headerLines_;
+    size_t headerBytes_;
+
+    size_t maxBodySize_;
+    size_t inlineBodyLimit_;
+    BodyCallback bodyCallback_;
+    BodyHandoff bodyHandoff_;
+    size_t contentLength_;
+    int lengthFields_;    // Content-Length fields seen, an empty one included
+    bool lengthConflict_; // two of them disagree, so the body length is ambiguous
+    bool handedOff_;
+    size_t bodyRemaining_; // of the Content-Length body or the current chunk
+    size_t bodyBytes_;
+    bool bodyInBuffer_;    // body() is bodyRange_ rather than body_
+    bool streamBody_;
+    std::string body_;     // copied or de-chunked body
+    Range bodyRange_;
+
+    // kCopy storage
     std::string path_;
     std::string query_;
     std::map<std::string, std::string> headers_;
+
+    // kView storage: a flat vector instead of node-based map
+    const Buffer* buf_;
+    const char* base_; // buf_->peek() during parseRequest(), for computing ranges
+    size_t parsed_;    // bytes of the current request already parsed, retrieved by consume()
+    Range pathRange_;
+    Range queryRange_;
+    std::vector<std::pair<Range, Range>> headerRanges_;
 };
@@ -1,10 +1,16 @@
 #pragma once
 
 #include "Channel.h"
+#include "CharScan.h"
 #include "EventLoop.h"
-#include "Logger.h"
+#include "FileCache.h"
+#include "Logging.h"
+#include "OutputQueue.h"
+#include "ResponseCache.h"
 #include "Timer.h"
+#include "TimerId.h"
 #include "Util.h"
+#include <cstring>
 #include <dirent.h>
 #include <fcntl.h>
 #include <filesystem>
@@ -12,8 +18,10 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <strings.h>
 #include <sys/epoll.h>
 #include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -21,10 +29,14 @@
 
 constexpr int DEFAULT_EXPIRED_TIME = 3000;
 constexpr int DEFAULT_KEEP_ALIVE_TIME = 5 * 60 * 1000; // the default keep-alive time is 5 minutes
+constexpr size_t MAX_REQUEST_LINE = 8 * 1024;           // longer request lines are answered with 414
+constexpr size_t MAX_HEADER_LINE = 8 * 1024;            // limits on a header line, the header block
+constexpr size_t MAX_HEADER_BYTES = 64 * 1024;          // and the number of headers, answered with 431
+constexpr int MAX_HEADER_COUNT = 100;
+constexpr size_t MAX_BODY_SIZE = 8 * 1024 * 1024;       // longer request bodies are answered with 413
 
 class EventLoop;
 class Channel;
-class TimerNode;
 
 class HttpData : public std::enable_shared_from_this<HttpData>
 {
@@ -77,62 +89,59 @@ private:
         AGAIN,
         ERROR,
         SUCCESS,
-        PATHUNINVALID
+        PATHUNINVALID,
+        TOOLONG
     };
 
     enum class HeaderState
     {
         AGAIN,
         ERROR,
-        SUCCESS
+        SUCCESS,
+        TOOLARGE
     };
 
-    enum class AnalyzeState
+    enum class BodyState
     {
+        AGAIN,
         ERROR,
-        SUCCESS
+        SUCCESS,
+        TOOLARGE,
+        UNSUPPORTED
     };
 
-    const std::unordered_map<std::string, std::string> mime = {
-        {".html", "text/html"},
-        {".avi", "video/x-msvideo"},
-        {".mp4", "video/mp4"},
-        {".bmp", "image/bmp"},
-        {".c", "text/plain"},
-        {".cpp", "text/plain"},
-        {".doc", "application/msword"},
-        {".gif", "image/gif"},
-        {".gz", "application/x-gzip"},
-        {".htm", "text/html"},
-        {".ico", "image/x-icon"},
-        {".jpg", "image/jpeg"},
-        {".png", "image/png"},
-        {".txt", "text/plain"},
-        {".mp3", "audio/mp3"},
-        {"default", "text/html"}};
-    std::string getMime(const std::string& suffix)
+    enum class BodyFraming
+    {
+        NONE, // not determined yet
+        LENGTH,
+        CHUNKED
+    };
+
+    enum class ChunkState
+    {
+        SIZE,
+        DATA,
+        DATA_CRLF,
+        TRAILER
+    };
+
+    enum class AnalyzeState
     {
-        auto it = mime.find(suffix);
-        if (it != mime.end())
-        {
-            return it->second;
-        }
-        else
-        {
-            return mime.at("default");
-        }
-    }
+        ERROR,
+        SUCCESS
+    };
 
     const std::string ROOT_DIR = std::filesystem::current_path().string() + "/Resource"; // set resource directory
 
 private:
-    std::shared_ptr<EventLoop> loop_;  // the event loop which manages this HttpData
+    EventLoop* loop_;                  // the event loop which manages this HttpData
     std::shared_ptr<Channel> channel_; // the channel of this HttpData
-    std::weak_ptr<TimerNode> timer_;   // timer_ is managed by timerManager, so it is a weak pointer
+    TimerId timer_;                    // closes the connection when it expires, cancelled on activity
+    std::shared_ptr<HttpData> self_;   // keeps this alive while the channel is registered, until handleClose()
 
     int fd_;
     std::string inBuffer_;            // Input buffer
-    std::string outBuffer_;           // Output buffer
+    OutputQueue outputQueue_;         // Response headers, shared cached bodies and files to stream, flushed in order
     bool error_;                      // Error flag
     ConnectionState connectionState_; // Connection state
     HttpMethod httpMethod_;
@@ -142,6 +151,9 @@ private:
     std::string path_;
 
     int readIdx_;
+    size_t scanIdx_;     // where the search for the end of the line at readIdx_ resumes
+    int headerCount_;
+    size_t headerBytes_;
 
     ProcessState processState_;
     ParseState parseState_;
@@ -151,6 +163,11 @@ private:
 
     std::string request_line;
 
+    BodyFraming bodyFraming_;
+    ChunkState chunkState_;
+    size_t bodyRemaining_; // of the Content-Length body or the current chunk
+    std::string body_;     // the request body, de-chunked
+
 private:
     void handleConnect(); // Handle connection-related logic, adjust events and timeout.
 
@@ -159,6 +176,8 @@ private:
     void handleWrite(); // Handle write events, write buffer data to the socket.
 
 private:
+    size_t findLineEnd(size_t maxLen); // Find the CRLF ending the line at readIdx_, npos if it has not arrived within maxLen bytes
+
     URLState parseRequestLine(); // Process the request line
 
     bool parseHttpMethod(const std::string& request_line); // Parse the HTTP method from the request line
@@ -176,6 +195,15 @@ private:
 
     std::string trimTrailingSpaces(const std::string& str); // Remove trailing spaces and tabs from a string
 
+    const std::string* findHeader(const std::string& name) const; // Case-insensitive header lookup, nullptr if absent
+
+private:
+    BodyState parseBody(); // Process the request body, framed by Content-Length or chunked
+
+    BodyState startBody(); // Pick the body framing from the headers
+
+    BodyState parseChunkedBody(); // Decode a chunked body into body_
+
 private:
     AnalyzeState generateSendHTTP(); // Generate the HTTP response
 
@@ -185,23 +213,25 @@ private:
 
     std::string buildResponseHeader(const std::string& filetype); // Build the response header
 
+    std::string buildEntityHeader(const std::string& filetype, off_t fileSize); // Build the file headers that follow it, up to the blank line
+
     AnalyzeState handleHelloRequest(); // Handle "hello" requests
 
+    AnalyzeState handlePostRequest(); // Handle POST requests, acknowledging the received body
+
     AnalyzeState handleIndexRequest(std::string& header); // Handle "index.html" requests (file listing)
 
     AnalyzeState handleFileRequest(std::string& header, const std::string& filetype); // Handle regular file requests
 
-    AnalyzeState sendFileContent(const std::string& fullPath, const std::string& header, size_t fileSize); // Send file content
+    AnalyzeState sendFileContent(const FileCache::EntryPtr& entry, const std::string& header); // Queue the file to be streamed after the header
 
     bool curPathFileList(std::string path, std::string& body); // Handle file listing requests
 
 private:
-    void updateEventAndTimeout(std::shared_ptr<Channel> channel, unsigned int newEvent, int timeout); // Update events and expiration time
-
-    void updateEvent(std::shared_ptr<Channel> channel, unsigned int newEvent); // Update events
+    void resetTimer(int timeout); // Close the connection after timeout milliseconds without activity
 
 public:
-    HttpData(std::shared_ptr<EventLoop> loop, int fd);
+    HttpData(EventLoop* loop, int fd);
     ~HttpData();
 
     HttpData() = default;
@@ -211,10 +241,9 @@ public:
     HttpData& operator=(HttpData&&) = delete;
 
     void reset();
-    void linkTimer(std::shared_ptr<TimerNode> mtimer);
 
     void unlinkTimer();
-    std::shared_ptr<EventLoop> getLoop();
+    EventLoop* getLoop();
 
     std::shared_ptr<Channel> getChannel();
 
@@ -222,5 +251,6 @@ public:
     // Called when the connection is disconnected or needs to be closed.
     void handleClose();
 
+    // Register the connection with the loop: start reading and arm the first timeout
     void newEvent();
 };
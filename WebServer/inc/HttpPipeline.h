@@ -0,0 +1,53 @@
+#pragma once
+
+#include "OutputQueue.h"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <sys/types.h>
+
+class TcpConnection;
+
+// Keeps the responses to pipelined HTTP/1.1 requests in request order. Every parsed
+// request reserves a sequence number in the loop thread; its response is handed to
+// complete() with that number, possibly later and from another thread, and is held
+// back until the responses to all earlier requests have been sent.
+class HttpPipeline : public std::enable_shared_from_this<HttpPipeline>
+{
+public:
+    struct Response
+    {
+        std::string header;     // everything before body/file, including the blank line if no body follows in memory
+        OutputQueue::Blob body; // optional, sent after header without copying
+        OutputQueue::File file; // optional, streamed with sendfile after header
+        off_t offset = 0;
+        size_t len = 0;
+        bool close = false; // shut the connection down once this response is out
+    };
+
+    // Holds conn weakly, so the pipeline may be kept in the connection's context
+    explicit HttpPipeline(const std::shared_ptr<TcpConnection>& conn);
+
+    // Non-copyable
+    HttpPipeline(const HttpPipeline&) = delete;
+    HttpPipeline& operator=(const HttpPipeline&) = delete;
+
+    // Loop thread only
+    uint64_t reserve();
+    size_t pending() const { return slots_.size(); } // reserved but not yet sent
+
+    // Any thread
+    void complete(uint64_t seq, Response&& response);
+
+private:
+    void completeInLoop(uint64_t seq, Response&& response);
+    void send(const std::shared_ptr<TcpConnection>& conn, Response& response);
+
+    std::weak_ptr<TcpConnection> conn_;
+    std::deque<std::optional<Response>> slots_; // slots_[i] belongs to sequence number nextToSend_ + i
+    uint64_t nextSeq_;
+    uint64_t nextToSend_;
+    bool closing_; // a response asked for close, later ones are dropped
+};
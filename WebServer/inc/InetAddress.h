@@ -0,0 +1,50 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// IPv4/IPv6 socket address, cheap to copy and usable as a hash key
+class InetAddress
+{
+public:
+    InetAddress();
+    explicit InetAddress(const struct sockaddr_in& addr) : addr_(addr) {}
+    explicit InetAddress(const struct sockaddr_in6& addr) : addr6_(addr) {}
+    // addr must hold an AF_INET or AF_INET6 address, as filled by accept4/getsockname
+    explicit InetAddress(const struct sockaddr* addr);
+
+    sa_family_t family() const { return addr_.sin_family; }
+    bool isIpv6() const { return family() == AF_INET6; }
+    uint16_t port() const;
+
+    std::string toIp() const;
+    std::string toIpPort() const;
+
+    const struct sockaddr* getSockAddr() const { return reinterpret_cast<const struct sockaddr*>(&addr6_); }
+    socklen_t getSockAddrLen() const { return isIpv6() ? sizeof addr6_ : sizeof addr_; }
+
+    // hash of the address without the port, e.g. for per-client limits
+    size_t ipHash() const;
+    size_t hash() const;
+    bool sameIp(const InetAddress& other) const;
+    bool operator==(const InetAddress& other) const { return sameIp(other) && port() == other.port(); }
+    bool operator!=(const InetAddress& other) const { return !(*this == other); }
+
+private:
+    union
+    {
+        struct sockaddr_in addr_;
+        struct sockaddr_in6 addr6_;
+    };
+};
+
+namespace std
+{
+template <>
+struct hash<InetAddress>
+{
+    size_t operator()(const InetAddress& addr) const { return addr.hash(); }
+};
+} // namespace std
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Poller.h"
+#include <linux/io_uring.h>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class Channel;
+
+// Readiness poller built on one-shot IORING_OP_POLL_ADD requests.
+// Interest changes are only queued as SQEs and get submitted together with the
+// wait for completions, so one loop iteration costs a single io_uring_enter
+// instead of an epoll_ctl per change plus epoll_wait.
+class IoUringPoller : public Poller
+{
+public:
+    IoUringPoller();
+    ~IoUringPoller() override;
+
+    // Non-copyable
+    IoUringPoller(const IoUringPoller&) = delete;
+    IoUringPoller& operator=(const IoUringPoller&) = delete;
+
+    // false if the kernel does not support io_uring (or lacks IORING_FEAT_EXT_ARG/NODROP)
+    bool valid() const { return ringFd_ >= 0; }
+
+    void updateChannel(Channel* channel) override;
+    void removeChannel(Channel* channel) override;
+    bool hasChannel(Channel* channel) const override;
+
+    void poll(int timeoutMs, ChannelList* activeChannels) override;
+
+private:
+    struct Registration
+    {
+        Channel* channel;
+        uint32_t generation; // tells completions of a previous arming apart from the current one
+        uint32_t armedEvents;
+        bool armed;
+    };
+
+    struct Completion
+    {
+        uint64_t userData;
+        int res;
+    };
+
+    bool setupRing(unsigned entries);
+    void closeRing();
+    struct io_uring_sqe* getSqe();
+    int enter(unsigned minComplete, int timeoutMs);
+    void reapCompletions();
+    void armPoll(int fd, Registration& reg);
+    void cancelPoll(Registration& reg);
+    uint32_t nextGeneration();
+
+    static const unsigned kRingEntries = 256;
+
+    int ringFd_;
+
+    // submission queue ring
+    void* sqRing_;
+    size_t sqRingSize_;
+    unsigned* sqHead_;
+    unsigned* sqTail_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    struct io_uring_sqe* sqes_;
+    size_t sqesSize_;
+    unsigned sqeTail_; // local tail, published to *sqTail_ on enter()
+
+    // completion queue ring
+    void* cqRing_;
+    size_t cqRingSize_;
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned cqMask_;
+    struct io_uring_cqe* cqes_;
+
+    uint32_t generation_;
+    std::unordered_map<int, Registration> channels_;
+    std::vector<int> rearmFds_; // fds whose one-shot poll fired during the last poll()
+    std::vector<Completion> completions_; // taken off the CQ but not yet handed to channels
+};
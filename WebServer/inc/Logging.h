@@ -0,0 +1,24 @@
+#pragma once
+
+// LOG(name) << ... is provided by the Log module. When the tree is built
+// without it, each statement becomes one line on stderr instead.
+#if __has_include("Logger.h")
+#include "Logger.h"
+#else
+#include <iostream>
+
+class StderrLogLine
+{
+public:
+    ~StderrLogLine() { std::cerr << '\n'; }
+
+    template <typename T>
+    StderrLogLine& operator<<(const T& value)
+    {
+        std::cerr << value;
+        return *this;
+    }
+};
+
+#define LOG(name) StderrLogLine()
+#endif
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+// Unbounded lock-free multi-producer single-consumer queue (Vyukov's intrusive
+// design with a stub node). push() may be called from any thread and never
+// blocks; pop() must only be called from the single consumer thread.
+template <typename T>
+class MpscQueue
+{
+public:
+    MpscQueue()
+        : head_(&stub_),
+          tail_(&stub_)
+    {
+    }
+
+    ~MpscQueue()
+    {
+        T value;
+        while (pop(value))
+        {
+        }
+    }
+
+    // Non-copyable
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(T value)
+    {
+        pushNode(new Node(std::move(value)));
+    }
+
+    // Returns false when the queue is empty, or when the next element is still
+    // being linked in by a producer; that producer's push completes right after.
+    bool pop(T& value)
+    {
+        Node* tail = tail_;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (tail == &stub_)
+        {
+            if (next == nullptr)
+            {
+                return false;
+            }
+            tail_ = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+
+        if (next == nullptr)
+        {
+            if (tail != head_.load(std::memory_order_acquire))
+            {
+                return false; // a producer swapped head_ but has not linked its node yet
+            }
+            // tail is the last node: re-insert the stub so tail can be unlinked
+            pushNode(&stub_);
+            next = tail->next.load(std::memory_order_acquire);
+            if (next == nullptr)
+            {
+                return false;
+            }
+        }
+
+        tail_ = next;
+        value = std::move(tail->value);
+        delete tail;
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        Node() : next(nullptr) {}
+        explicit Node(T v) : next(nullptr), value(std::move(v)) {}
+
+        std::atomic<Node*> next;
+        T value;
+    };
+
+    void pushNode(Node* node)
+    {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    std::atomic<Node*> head_; // producers' end
+    Node* tail_;              // consumer's end
+    Node stub_;
+};
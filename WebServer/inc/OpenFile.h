@@ -0,0 +1,25 @@
+#pragma once
+
+#include <unistd.h>
+
+// Owns an open file descriptor, shared by everything that streams from the file
+class OpenFile
+{
+public:
+    explicit OpenFile(int fd) : fd_(fd) {}
+    ~OpenFile()
+    {
+        if (fd_ >= 0)
+        {
+            close(fd_);
+        }
+    }
+
+    OpenFile(const OpenFile&) = delete;
+    OpenFile& operator=(const OpenFile&) = delete;
+
+    int fd() const { return fd_; }
+
+private:
+    const int fd_;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "OpenFile.h"
+#include "SlabPool.h"
+#include <deque>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+
+// Pending output of a connection kept as a chain of segments. Memory segments are flushed
+// with writev, so headers and bodies reach the socket without first being copied together;
+// file segments are streamed with sendfile and never enter user space.
+class OutputQueue
+{
+public:
+    using Blob = std::shared_ptr<const std::string>;
+    using File = std::shared_ptr<const OpenFile>;
+
+    // alloc backs the segment list; the data of owned segments uses the global allocator
+    explicit OutputQueue(const PoolAllocator<char>& alloc = PoolAllocator<char>()) : segments_(alloc), readableBytes_(0) {}
+
+    size_t readableBytes() const { return readableBytes_; }
+    bool empty() const { return segments_.empty(); }
+
+    // Copies the data; small pieces are coalesced into the last owned segment
+    void append(const char* data, size_t len);
+    // Takes ownership without copying
+    void append(std::string&& data, size_t offset = 0);
+    // Shares an immutable blob (e.g. a cached response) without copying
+    void append(const Blob& blob, size_t offset = 0);
+    // Streams len bytes of the file starting at offset, tracking progress across partial writes
+    void appendFile(const File& file, off_t offset, size_t len);
+
+    // Writes segments in order until the socket would block, returns bytes written or -1.
+    // A file that ends before its segment does fails with EIO.
+    ssize_t writeFd(int fd, int* savedErrno);
+
+private:
+    struct Segment
+    {
+        std::string owned;
+        Blob blob;
+        File file;
+        size_t offset; // offset into owned/blob/file, advanced by partial writes; not a pointer since moving owned may relocate its data
+        size_t len;
+
+        const char* data() const { return (blob ? blob->data() : owned.data()) + offset; }
+    };
+
+    static const size_t kCoalesceLimit = 4096;
+    static const int kMaxIovecs = 64;
+
+    ssize_t writeMemory(int fd, size_t* attempted);
+    ssize_t writeFile(int fd, size_t* attempted);
+    void retrieve(size_t len);
+
+    std::deque<Segment, PoolAllocator<Segment>> segments_;
+    size_t readableBytes_;
+};
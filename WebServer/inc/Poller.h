@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+
+class Channel;
+
+// Interface shared by the I/O multiplexing backends owned by EventLoop
+class Poller
+{
+public:
+    using ChannelList = std::vector<Channel*>;
+
+    virtual ~Poller() = default;
+
+    virtual void updateChannel(Channel* channel) = 0;
+    virtual void removeChannel(Channel* channel) = 0;
+    virtual bool hasChannel(Channel* channel) const = 0;
+
+    // Appends the ready channels to the caller-owned list, which is expected to be
+    // empty and is reused across iterations so polling does not allocate.
+    virtual void poll(int timeoutMs, ChannelList* activeChannels) = 0;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "FileCache.h"
+#include "OutputQueue.h"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// LRU cache of serialized responses for small static files, bounded by total bytes.
+// A cached object holds the entity headers, the blank line and the body in one immutable
+// blob shared by all loops; the per-request status line and connection headers are sent
+// in front of it, so a hit is one writev without touching the file. The entity headers
+// are built here from the file alone, so every handler sharing an entry sends the same ones.
+class ResponseCache
+{
+public:
+    struct Response
+    {
+        OutputQueue::Blob data; // entity headers + "\r\n" + body
+        // validators taken from the FileCache entry the body was read from
+        ino_t ino;
+        off_t size;
+        struct timespec mtime;
+    };
+    using ResponsePtr = std::shared_ptr<const Response>;
+
+    static const size_t kDefaultMaxBytes = 32 * 1024 * 1024;
+    static const size_t kDefaultMaxObjectSize = 64 * 1024;
+
+    explicit ResponseCache(size_t maxBytes = kDefaultMaxBytes, size_t maxObjectSize = kDefaultMaxObjectSize);
+
+    // Process-wide instance used by the static file handlers
+    static ResponseCache& instance();
+
+    bool cacheable(const FileCache::Entry& file) const { return file.file && static_cast<size_t>(file.st.st_size) <= maxObjectSize_; }
+
+    // Content type by file extension, text/html when unknown
+    static std::string mimeType(const std::string& filename);
+    // Content-Type, Content-Length and Server headers followed by the blank line
+    static std::string entityHeaders(const std::string& contentType, off_t size);
+
+    // Returns the cached response if it still matches the file's current metadata
+    ResponsePtr lookup(const FileCache::Entry& file);
+    // Reads the file and caches its entity headers + body, returns nullptr if it cannot be read
+    ResponsePtr insert(const FileCache::Entry& file);
+
+    size_t totalBytes();
+
+private:
+    struct Slot
+    {
+        ResponsePtr response;
+        std::list<std::string>::iterator lruPos;
+    };
+
+    void eraseLocked(std::unordered_map<std::string, Slot>::iterator it);
+
+    const size_t maxBytes_;
+    const size_t maxObjectSize_;
+    std::mutex mutex_;
+    size_t totalBytes_;
+    std::list<std::string> lru_; // most recently used first
+    std::unordered_map<std::string, Slot> responses_;
+};
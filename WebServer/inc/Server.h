@@ -4,39 +4,81 @@
 #include "EventLoopThreadPool.h"
 #include "TcpConnection.h"
 #include "Acceptor.h"
-#include <map>
+#include "ConnectionRegistry.h"
+#include <atomic>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 class Server
 {
 public:
     using ConnectionCallback = TcpConnection::ConnectionCallback;
     using MessageCallback = TcpConnection::MessageCallback;
+    using WriteCompleteCallback = TcpConnection::WriteCompleteCallback;
+    using HighWaterMarkCallback = TcpConnection::HighWaterMarkCallback;
 
-    Server(EventLoop* loop, int threadNum, int port);
+    // With reusePort every I/O loop owns its own SO_REUSEPORT listening socket and
+    // accepts the connections it serves, instead of the base loop accepting them all.
+    Server(EventLoop* loop, int threadNum, int port, bool reusePort = false);
     ~Server();
 
+    // How new connections are spread over the I/O loops, set before start(). Only the
+    // single acceptor uses it; with reusePort the kernel picks the socket and thus the loop.
+    void setSelectionPolicy(EventLoopThreadPool::SelectionPolicy policy) { threadPool_->setSelectionPolicy(policy); }
+    void setLoopSelector(const EventLoopThreadPool::LoopSelector& selector) { threadPool_->setLoopSelector(selector); }
+    // Pins the I/O threads, see EventLoopThreadPool::setCpuAffinity; set before start().
+    // With reusePort each listener of a loop pinned to one CPU asks for that CPU's connections.
+    void setCpuAffinity(const std::vector<EventLoopThread::CpuSet>& cpus) { threadPool_->setCpuAffinity(cpus); }
+
     void start();
+
+    // Current number of connections, summed over the I/O loops; safe from any thread
+    size_t connectionCount() const;
+    // Runs visitor for every connection, in the loop that owns it; returns without waiting
+    void forEachConnection(const ConnectionRegistry::Visitor& visitor);
     
     void setConnectionCallback(const ConnectionCallback& cb) { connectionCallback_ = cb; }
     void setMessageCallback(const MessageCallback& cb) { messageCallback_ = cb; }
+    void setWriteCompleteCallback(const WriteCompleteCallback& cb) { writeCompleteCallback_ = cb; }
+    void setHighWaterMarkCallback(const HighWaterMarkCallback& cb, size_t highWaterMark)
+    {
+        highWaterMarkCallback_ = cb;
+        highWaterMark_ = highWaterMark;
+    }
+
+    // Connection timeouts in seconds, 0 disables one; see TcpConnection::Timeouts for the
+    // defaults. They take effect for connections accepted afterwards.
+    void setIdleTimeout(double seconds) { timeouts_.idle = toDuration(seconds); }
+    void setHeaderTimeout(double seconds) { timeouts_.header = toDuration(seconds); }
+    void setWriteTimeout(double seconds) { timeouts_.write = toDuration(seconds); }
 
 private:
+    static TimingWheel::Duration toDuration(double seconds) { return TimingWheel::Duration(static_cast<int64_t>(seconds * 1000)); }
+
     void newConnection(int sockfd, const InetAddress& peerAddr);
-    void removeConnection(const std::shared_ptr<TcpConnection>& conn);
-    void removeConnectionInLoop(const std::shared_ptr<TcpConnection>& conn);
+    void newConnectionInLoop(EventLoop* ioLoop, int sockfd, const InetAddress& peerAddr);
+    void establishConnection(EventLoop* ioLoop, int sockfd, const InetAddress& peerAddr);
+    void removeConnection(ConnectionRegistry* registry, const std::shared_ptr<TcpConnection>& conn);
 
-    using ConnectionMap = std::map<std::string, std::shared_ptr<TcpConnection>>;
+    using RegistryMap = std::unordered_map<EventLoop*, std::unique_ptr<ConnectionRegistry>>;
 
     EventLoop* loop_;
     int threadNum_;
+    int port_;
+    bool reusePort_;
     std::unique_ptr<EventLoopThreadPool> threadPool_;
-    std::unique_ptr<Acceptor> acceptor_;
+    std::unique_ptr<Acceptor> acceptor_;            // single acceptor on the base loop
+    std::vector<Acceptor*> loopAcceptors_;          // reusePort: one per I/O loop, destroyed in its own loop
     
     ConnectionCallback connectionCallback_;
     MessageCallback messageCallback_;
+    WriteCompleteCallback writeCompleteCallback_;
+    HighWaterMarkCallback highWaterMarkCallback_;
+    size_t highWaterMark_;
+    TcpConnection::Timeouts timeouts_;
     
     bool started_;
-    int nextConnId_;
-    ConnectionMap connections_;
+    std::atomic<uint64_t> nextConnId_;
+    RegistryMap registries_; // one per I/O loop, filled in start() and read-only afterwards
 };
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+// Per-loop memory pool for the objects every connection allocates: the TcpConnection
+// itself and the storage of its buffers. Blocks are recycled through per-size free lists,
+// so connection churn stops going through the global allocator once the pool is warm.
+//
+// Only the owner thread (the loop's) allocates and recycles blocks directly. A block freed
+// on another thread, e.g. a connection whose last reference was dropped by a worker, is
+// pushed onto a lock-free list and picked up by the owner on its next allocation. Other
+// threads may allocate too, but they bypass the free lists and take a fresh block from the
+// global allocator, which the pool recycles like its own once freed.
+// Memory is kept at its peak until the pool is destroyed; requests above kMaxBlock go to
+// the global allocator.
+class SlabPool
+{
+public:
+    static const size_t kGranularity = 64;
+    static const size_t kMaxBlock = 4096;
+    static const size_t kChunkSize = 64 * 1024;
+
+    // With numaNode >= 0 chunks are mapped directly and placed on that node, so a loop pinned
+    // there keeps its connections in local memory; otherwise they come from operator new
+    explicit SlabPool(int numaNode = -1);
+    ~SlabPool();
+
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    void* allocate(size_t size);
+    // size must be the one passed to allocate(); may be called from any thread
+    void deallocate(void* p, size_t size);
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock* next;
+        size_t sizeClass; // set for blocks on remoteFree_ only
+    };
+
+    static const size_t kClasses = kMaxBlock / kGranularity;
+
+    static size_t sizeClass(size_t size) { return (size + kGranularity - 1) / kGranularity - 1; }
+
+    void* carve(size_t sizeClass);
+    char* newChunk();
+    void* allocateForeign(size_t sizeClass);
+    void reclaimRemote();
+
+    const std::thread::id owner_;
+    const int numaNode_;
+    FreeBlock* freeLists_[kClasses];
+    std::atomic<FreeBlock*> remoteFree_;
+    std::vector<char*> chunks_;
+    char* chunkCursor_;
+    char* chunkEnd_;
+    std::mutex foreignMutex_;
+    std::vector<void*> foreignBlocks_; // allocated off the owner thread, released with the chunks
+};
+
+// STL allocator on top of a SlabPool; a default-constructed one uses the global allocator.
+// Copies share the pool, which stays alive until the last block allocated from it is freed.
+template <typename T>
+class PoolAllocator
+{
+public:
+    using value_type = T;
+
+    PoolAllocator() = default;
+    explicit PoolAllocator(std::shared_ptr<SlabPool> pool) : pool_(std::move(pool)) {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) : pool_(other.pool_) {}
+
+    T* allocate(size_t n)
+    {
+        if (pool_)
+        {
+            return static_cast<T*>(pool_->allocate(n * sizeof(T)));
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        if (pool_)
+        {
+            pool_->deallocate(p, n * sizeof(T));
+        }
+        else
+        {
+            ::operator delete(p);
+        }
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>& other) const { return pool_ == other.pool_; }
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>& other) const { return pool_ != other.pool_; }
+
+private:
+    template <typename U>
+    friend class PoolAllocator;
+
+    std::shared_ptr<SlabPool> pool_;
+};
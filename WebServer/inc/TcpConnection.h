@@ -2,37 +2,84 @@
 
 #include "EventLoop.h"
 #include "Buffer.h"
+#include "Channel.h"
+#include "FileReceiver.h"
+#include "InetAddress.h"
+#include "OutputQueue.h"
+#include "TimingWheel.h"
 #include <memory>
 #include <string>
 #include <atomic>
 #include <any>
 
-class Channel;
-
 class TcpConnection : public std::enable_shared_from_this<TcpConnection>
 {
 public:
     using ConnectionCallback = std::function<void(const std::shared_ptr<TcpConnection>&)>;
     using CloseCallback = std::function<void(const std::shared_ptr<TcpConnection>&)>;
     using MessageCallback = std::function<void(const std::shared_ptr<TcpConnection>&, Buffer*)>;
+    using WriteCompleteCallback = std::function<void(const std::shared_ptr<TcpConnection>&)>;
+    using HighWaterMarkCallback = std::function<void(const std::shared_ptr<TcpConnection>&, size_t pending)>;
+    using ReceiveCompleteCallback = std::function<void(const std::shared_ptr<TcpConnection>&, size_t received, bool ok)>;
+
+    // A connection is closed when it stays too long in one of three situations; zero disables
+    struct Timeouts
+    {
+        TimingWheel::Duration idle{60000};   // nothing buffered either way, e.g. an idle keep-alive
+        TimingWheel::Duration header{20000}; // input waiting for the rest of its request; more bytes do not extend it
+        TimingWheel::Duration write{60000};  // output pending without the peer taking any of it
+    };
 
-    TcpConnection(EventLoop* loop, const std::string& name, int sockfd);
+    TcpConnection(EventLoop* loop, uint64_t id, int sockfd, const InetAddress& peerAddr);
+    // Allocates the connection and its buffers from loop's pool; call from the loop thread
+    static std::shared_ptr<TcpConnection> create(EventLoop* loop, uint64_t id, int sockfd, const InetAddress& peerAddr);
     ~TcpConnection();
 
     EventLoop* getLoop() const { return loop_; }
-    const std::string& name() const { return name_; }
+    uint64_t id() const { return id_; }
+    // formatted on demand, only logging needs it
+    std::string name() const { return "Connection-" + std::to_string(id_); }
     int fd() const { return fd_; }
+    const InetAddress& peerAddress() const { return peerAddr_; }
+    // resolved with getsockname on first use, call from the loop thread
+    const InetAddress& localAddress();
     bool connected() const { return state_ == kConnected; }
     bool disconnected() const { return state_ == kDisconnected; }
 
     void send(const std::string& message);
     void send(Buffer* message);
+    // Zero-copy variants: the string is moved into the output queue, blobs are shared
+    void send(std::string&& message);
+    void send(const OutputQueue::Blob& blob);
+    void send(std::string&& header, const OutputQueue::Blob& body);
+    // Streams len bytes of file from offset with sendfile after the header; memory use
+    // stays constant regardless of the file size
+    void sendFile(std::string&& header, const OutputQueue::File& file, off_t offset, size_t len);
+    // Moves the next len bytes of input into file at offset: first what the input Buffer
+    // already holds, then straight from the socket with splice as it arrives. These bytes
+    // never reach the message callback. cb runs in the loop thread once they are all in the
+    // file, or with ok false if writing failed or the peer went away. Loop thread only.
+    void receiveToFile(const std::shared_ptr<const OpenFile>& file, off_t offset, size_t len, const ReceiveCompleteCallback& cb);
+    bool receivingToFile() const { return receiver_ != nullptr; }
     void shutdown();
     void forceClose();
 
     void setConnectionCallback(const ConnectionCallback& cb) { connectionCallback_ = cb; }
     void setMessageCallback(const MessageCallback& cb) { messageCallback_ = cb; }
     void setCloseCallback(const CloseCallback& cb) { closeCallback_ = cb; }
+    // Runs once all output has been handed to the kernel; together with the high water
+    // mark callback this lets a producer pause and resume instead of queueing without bound
+    void setWriteCompleteCallback(const WriteCompleteCallback& cb) { writeCompleteCallback_ = cb; }
+    // Runs inside the send that makes pending output, file segments included, reach
+    // highWaterMark bytes
+    void setHighWaterMarkCallback(const HighWaterMarkCallback& cb, size_t highWaterMark)
+    {
+        highWaterMarkCallback_ = cb;
+        highWaterMark_ = highWaterMark;
+    }
+    size_t pendingOutputBytes() const { return outputQueue_.readableBytes(); }
+    // Set before connectEstablished()
+    void setTimeouts(const Timeouts& timeouts) { timeouts_ = timeouts; }
 
     void setContext(const std::any& context) { context_ = context; }
     const std::any& getContext() const { return context_; }
@@ -41,32 +88,57 @@ public:
     // Internal use
     void connectEstablished();
     void connectDestroyed();
+    size_t registryIndex() const { return registryIndex_; }
+    void setRegistryIndex(size_t index) { registryIndex_ = index; }
 
 private:
     enum StateE { kDisconnected, kConnecting, kConnected, kDisconnecting };
+    enum TimeoutE { kNoTimeout, kIdleTimeout, kHeaderTimeout, kWriteTimeout };
 
     void handleRead();
     void handleWrite();
     void handleClose();
     void handleError();
+    void handleReceive();
+    void finishReceive(bool ok);
+    void updateTimeout(bool wrote = false);
+    void handleTimeout();
     
     void sendInLoop(const std::string& message);
     void sendInLoop(const char* data, size_t len);
+    void sendInLoop(std::string&& header, const OutputQueue::Blob& body);
+    void sendFileInLoop(std::string&& header, const OutputQueue::File& file, off_t offset, size_t len);
+    void flushOutputInLoop();
+    void checkHighWaterMark(size_t pendingBefore);
+    void queueWriteComplete();
     void shutdownInLoop();
     void forceCloseInLoop();
 
     EventLoop* loop_;
-    const std::string name_;
+    const uint64_t id_;
+    size_t registryIndex_; // position in the owning loop's ConnectionRegistry
     int fd_;
     std::atomic<StateE> state_;
-    std::unique_ptr<Channel> channel_;
+    Channel channel_;
+    const InetAddress peerAddr_; // filled by accept4, no getpeername needed
+    InetAddress localAddr_;
+    bool localAddrResolved_;
     
     Buffer inputBuffer_;
-    Buffer outputBuffer_;
+    OutputQueue outputQueue_;
+    std::unique_ptr<FileReceiver> receiver_; // set while input bypasses inputBuffer_
+    ReceiveCompleteCallback receiveCompleteCallback_;
+
+    Timeouts timeouts_;
+    TimeoutE timeout_;               // which of the timeouts timeoutEntry_ is counting down
+    TimingWheel::Entry timeoutEntry_; // on the loop's timing wheel
     
     std::any context_;
     
     ConnectionCallback connectionCallback_;
     MessageCallback messageCallback_;
     CloseCallback closeCallback_;
+    WriteCompleteCallback writeCompleteCallback_;
+    HighWaterMarkCallback highWaterMarkCallback_;
+    size_t highWaterMark_;
 };
@@ -1,10 +1,12 @@
 #pragma once
 #include <functional>
+#include <atomic>
 #include <chrono>
 #include <set>
 #include <vector>
 #include <memory>
 #include "Channel.h"
+#include "TimerId.h"
 
 class EventLoop;
 
@@ -15,20 +17,25 @@ public:
     using Timestamp = Clock::time_point;
 
     TimerNode(TimerCallback cb, Timestamp when, double interval)
-        : callback_(cb), expiration_(when), interval_(interval), repeat_(interval > 0.0) {}
+        : callback_(cb), expiration_(when), interval_(interval), repeat_(interval > 0.0), sequence_(++numCreated_) {}
 
     void run() const { if (callback_) callback_(); }
     Timestamp expiration() const { return expiration_; }
     bool repeat() const { return repeat_; }
+    int64_t sequence() const { return sequence_; }
     void restart(Timestamp now) { 
         expiration_ = now + std::chrono::milliseconds(static_cast<int64_t>(interval_ * 1000)); 
     }
+    void setExpiration(Timestamp when) { expiration_ = when; }
 
 private:
     TimerCallback callback_;
     Timestamp expiration_;
     double interval_;
     bool repeat_;
+    const int64_t sequence_;
+
+    static std::atomic<int64_t> numCreated_;
 };
 
 class TimerManager {
@@ -40,12 +47,21 @@ public:
     explicit TimerManager(EventLoop* loop);
     ~TimerManager();
 
-    void addTimer(TimerCallback cb, Timestamp when, double interval);
+    // All three may be called from any thread. cancel() and restart() do nothing once a
+    // one-shot timer has run; a repeating timer can cancel itself from its own callback.
+    TimerId addTimer(TimerCallback cb, Timestamp when, double interval);
+    void cancel(TimerId timerId);
+    // Moves the next expiration to when; a repeating timer keeps its interval afterwards
+    void restart(TimerId timerId, Timestamp when);
 
 private:
     using Entry = std::pair<Timestamp, TimerNode*>;
     using TimerList = std::set<Entry>;
+    using ActiveTimer = std::pair<TimerNode*, int64_t>;
+    using ActiveTimerSet = std::set<ActiveTimer>;
 
+    void cancelInLoop(TimerId timerId);
+    void restartInLoop(TimerId timerId, Timestamp when);
     void handleRead();
     std::vector<Entry> getExpired(Timestamp now);
     void reset(const std::vector<Entry>& expired, Timestamp now);
@@ -55,4 +71,7 @@ private:
     int timerfd_;
     std::unique_ptr<Channel> timerfdChannel_;
     TimerList timers_;
+    ActiveTimerSet activeTimers_; // same timers as timers_ plus the batch handleRead() is running
+    ActiveTimerSet cancelingTimers_;  // cancelled from inside handleRead(), not re-inserted
+    ActiveTimerSet restartingTimers_; // restarted from inside handleRead(), kept even if one-shot
 };
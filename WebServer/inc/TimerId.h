@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+class TimerNode;
+
+// Handle to a timer returned by EventLoop::runAt/runAfter/runEvery, used to cancel or
+// restart it. Copyable and safe to keep after the timer has fired: the sequence number
+// tells a live timer apart from a later one allocated at the same address.
+class TimerId
+{
+public:
+    TimerId() : timer_(nullptr), sequence_(0) {}
+    TimerId(TimerNode* timer, int64_t sequence) : timer_(timer), sequence_(sequence) {}
+
+    bool valid() const { return timer_ != nullptr; }
+
+private:
+    friend class TimerManager;
+
+    TimerNode* timer_; // never dereferenced before the loop has checked that it is still live
+    int64_t sequence_;
+};
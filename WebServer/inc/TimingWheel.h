@@ -0,0 +1,99 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+class EventLoop;
+class Channel;
+
+// Hierarchical timing wheel for coarse timeouts such as idle keep-alive connections.
+// Scheduling, refreshing and cancelling are O(1) and never allocate: the caller owns an
+// intrusive Entry, typically a member of the object being timed out. Precision is one
+// tick; precise timers belong in TimerManager. Loop thread only.
+//
+// Four levels of 256/64/64/64 slots cover 2^26 ticks (about 78 days at 100 ms); longer
+// timeouts are clamped. Entries on the outer levels are cascaded inward as the wheel turns.
+class TimingWheel
+{
+public:
+    using Callback = std::function<void()>;
+    using Duration = std::chrono::milliseconds;
+
+    static constexpr Duration kDefaultTick = Duration(100);
+
+    // Intrusive list node; unlinks itself when destroyed, so an owner going away cancels it
+    class Entry
+    {
+    public:
+        explicit Entry(Callback cb = Callback()) : prev_(nullptr), next_(nullptr), wheel_(nullptr), expires_(0), callback_(std::move(cb)) {}
+        ~Entry();
+
+        Entry(const Entry&) = delete;
+        Entry& operator=(const Entry&) = delete;
+
+        void setCallback(Callback cb) { callback_ = std::move(cb); }
+        bool scheduled() const { return wheel_ != nullptr; }
+
+    private:
+        friend class TimingWheel;
+
+        Entry* prev_;
+        Entry* next_;
+        TimingWheel* wheel_;
+        uint64_t expires_; // tick
+        Callback callback_;
+    };
+
+    explicit TimingWheel(EventLoop* loop, Duration tick = kDefaultTick);
+    ~TimingWheel();
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    // Fires the entry's callback after timeout, rounded up to whole ticks. Scheduling an
+    // entry that is already pending moves it, which is how a timeout is refreshed.
+    void schedule(Entry* entry, Duration timeout);
+    void cancel(Entry* entry);
+
+    size_t size() const { return size_; }
+    Duration tick() const { return tick_; }
+
+private:
+    // Sentinel of a circular doubly-linked list of entries
+    struct Slot
+    {
+        Entry head;
+        Slot() { head.prev_ = head.next_ = &head; }
+    };
+
+    static const int kRootBits = 8;
+    static const int kLevelBits = 6;
+    static const int kLevels = 4;
+    static const uint64_t kRootSize = 1 << kRootBits;
+    static const uint64_t kLevelSize = 1 << kLevelBits;
+    static const uint64_t kMaxTicks = (uint64_t(1) << (kRootBits + (kLevels - 1) * kLevelBits)) - 1;
+
+    static void link(Entry* head, Entry* entry);
+    static void unlink(Entry* entry);
+
+    void place(Entry* entry);
+    uint64_t cascade(int level, uint64_t index);
+    void step(); // advances one tick and runs what expired
+    uint64_t elapsedTicks() const;
+    void handleRead();
+    void arm(bool on);
+
+    EventLoop* loop_;
+    const Duration tick_;
+    const std::chrono::steady_clock::time_point start_;
+    uint64_t current_; // ticks since start_ that have been processed
+    size_t size_;
+    Slot root_[kRootSize];
+    Slot levels_[kLevels - 1][kLevelSize];
+
+    int timerfd_;
+    std::unique_ptr<Channel> timerfdChannel_;
+    bool armed_;
+};
@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <string_view>
 
 ssize_t readn(int fd, void* buff, size_t n);
 ssize_t readn(int fd, std::string& inBuffer, bool& zero);
@@ -11,4 +12,8 @@ int setSocketNonBlocking(int fd);
 void setSocketNodelay(int fd);
 void setSocketNoLinger(int fd);
 void shutDownWR(int fd);
-int socket_bind_listen(int port);
+int socket_bind_listen(int port, bool reusePort = false);
+// For putting file names and request paths into generated HTML
+std::string escapeHtml(std::string_view text);
+std::string encodeUrlPath(std::string_view path); // percent-encodes all but unreserved characters and '/'
+bool decodeUrlPath(std::string_view path, std::string& decoded); // false for a malformed escape or an encoded NUL
@@ -1,25 +1,42 @@
 #include "Acceptor.h"
 #include "Util.h"
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <iostream>
 
-Acceptor::Acceptor(EventLoop* loop, int port)
+Acceptor::Acceptor(EventLoop* loop, int port, bool reusePort)
     : loop_(loop),
-      acceptSocket_(socket_bind_listen(port)),
+      acceptSocket_(socket_bind_listen(port, reusePort)),
       acceptChannel_(loop, acceptSocket_),
-      listening_(false)
+      listening_(false),
+      idleFd_(open("/dev/null", O_RDONLY | O_CLOEXEC))
 {
+    // handleRead() accepts until EAGAIN, which needs a non-blocking listening socket
+    setSocketNonBlocking(acceptSocket_);
     acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
 }
 
 Acceptor::~Acceptor()
 {
+    if (backoffTimer_.valid())
+    {
+        loop_->cancel(backoffTimer_); // in the loop thread, so it cannot fire afterwards
+    }
     acceptChannel_.disableAll();
     acceptChannel_.remove();
     close(acceptSocket_);
+    close(idleFd_);
+}
+
+void Acceptor::setIncomingCpu(int cpu)
+{
+    if (setsockopt(acceptSocket_, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof cpu) < 0)
+    {
+        perror("setsockopt SO_INCOMING_CPU");
+    }
 }
 
 void Acceptor::listen()
@@ -32,27 +49,83 @@ void Acceptor::listen()
 void Acceptor::handleRead()
 {
     loop_->assertInLoopThread();
-    struct sockaddr_in clientAddr;
-    socklen_t clientAddrLen = sizeof(clientAddr);
-    int connfd = accept4(acceptSocket_, (struct sockaddr*)&clientAddr, &clientAddrLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
-    if (connfd >= 0)
+    for (int i = 0; i < kMaxAcceptsPerRead; ++i)
     {
-        if (newConnectionCallback_)
+        struct sockaddr_in6 clientAddr; // large enough for either family
+        socklen_t clientAddrLen = sizeof(clientAddr);
+        int connfd = accept4(acceptSocket_, (struct sockaddr*)&clientAddr, &clientAddrLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (connfd >= 0)
         {
-            InetAddress addr; // TODO: Fill addr
-            newConnectionCallback_(connfd, addr);
+            if (newConnectionCallback_)
+            {
+                InetAddress peerAddr((struct sockaddr*)&clientAddr);
+                newConnectionCallback_(connfd, peerAddr);
+            }
+            else
+            {
+                close(connfd);
+            }
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            break; // backlog drained
+        }
+        else if (errno == EMFILE || errno == ENFILE)
+        {
+            // Out of fds: the pending connection stays readable and the level-triggered
+            // channel would spin. Shed it with the reserve fd instead.
+            perror("Acceptor::handleRead");
+            if (!dropPendingConnection())
+            {
+                break;
+            }
+        }
+        else if (errno == ECONNABORTED || errno == EINTR || errno == EPROTO || errno == EPERM)
+        {
+            continue; // this connection is gone, the next one may be fine
         }
         else
         {
-            close(connfd);
+            perror("Acceptor::handleRead");
+            break;
         }
     }
-    else
+}
+
+bool Acceptor::dropPendingConnection()
+{
+    if (idleFd_ >= 0)
     {
-        perror("Acceptor::handleRead");
-        if (errno == EMFILE)
+        close(idleFd_);
+        int connfd = accept(acceptSocket_, nullptr, nullptr);
+        if (connfd >= 0)
         {
-            // TODO: handle EMFILE gracefully
+            close(connfd);
         }
+        idleFd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (idleFd_ >= 0)
+        {
+            return true;
+        }
+        perror("Acceptor reserve fd"); // another thread took the fd meanwhile
+    }
+
+    // Nothing left to shed connections with: stop polling the listener for a while
+    // instead of spinning on it, and try to get the reserve fd back then
+    if (!backoffTimer_.valid())
+    {
+        acceptChannel_.disableReading();
+        backoffTimer_ = loop_->runAfter(kBackoffSeconds, std::bind(&Acceptor::resumeAfterBackoff, this));
     }
+    return false;
+}
+
+void Acceptor::resumeAfterBackoff()
+{
+    backoffTimer_ = TimerId();
+    if (idleFd_ < 0)
+    {
+        idleFd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+    acceptChannel_.enableReading();
 }
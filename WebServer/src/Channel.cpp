@@ -29,6 +29,11 @@ void Channel::update()
     loop_->updateChannel(this);
 }
 
+void Channel::remove()
+{
+    loop_->removeChannel(this);
+}
+
 void Channel::handleEvent()
 {
     if (tied_)
@@ -0,0 +1,155 @@
+#include "CharScan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHARSCAN_X86 1
+#endif
+
+namespace
+{
+struct Scanner
+{
+    const char* (*findCRLF)(const char*, const char*);
+    const char* (*findChar)(const char*, const char*, char);
+    const char* name;
+};
+
+const char* findCRLFScalar(const char* p, const char* end)
+{
+    for (; end - p >= 2; ++p)
+    {
+        if (p[0] == '\r' && p[1] == '\n')
+        {
+            return p;
+        }
+    }
+    return end;
+}
+
+const char* findCharScalar(const char* p, const char* end, char c)
+{
+    for (; p < end; ++p)
+    {
+        if (*p == c)
+        {
+            return p;
+        }
+    }
+    return end;
+}
+
+#ifdef CHARSCAN_X86
+// A CRLF starts at every position where the byte is '\r' and the byte after it is '\n',
+// so one unaligned load at p and one at p + 1 test a whole block at once. The loops need
+// a spare byte past the block for the second load, the scalar code finishes the tail.
+
+__attribute__((target("sse2")))
+const char* findCRLFSse2(const char* p, const char* end)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    while (end - p >= 17)
+    {
+        __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, cr), _mm_cmpeq_epi8(second, lf)));
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return findCRLFScalar(p, end);
+}
+
+__attribute__((target("sse2")))
+const char* findCharSse2(const char* p, const char* end, char c)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    while (end - p >= 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return findCharScalar(p, end, c);
+}
+
+__attribute__((target("avx2")))
+const char* findCRLFAvx2(const char* p, const char* end)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    while (end - p >= 33)
+    {
+        __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, cr), _mm256_cmpeq_epi8(second, lf))));
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return findCRLFSse2(p, end);
+}
+
+__attribute__((target("avx2")))
+const char* findCharAvx2(const char* p, const char* end, char c)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    while (end - p >= 32)
+    {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return findCharSse2(p, end, c);
+}
+#endif
+
+Scanner selectScanner()
+{
+#ifdef CHARSCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return Scanner{findCRLFAvx2, findCharAvx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return Scanner{findCRLFSse2, findCharSse2, "sse2"};
+    }
+#endif
+    return Scanner{findCRLFScalar, findCharScalar, "scalar"};
+}
+
+const Scanner& scanner()
+{
+    static const Scanner s = selectScanner();
+    return s;
+}
+} // namespace
+
+const char* findCRLF(const char* begin, const char* end)
+{
+    return scanner().findCRLF(begin, end);
+}
+
+const char* findChar(const char* begin, const char* end, char c)
+{
+    return scanner().findChar(begin, end, c);
+}
+
+const char* charScanImplementation()
+{
+    return scanner().name;
+}
@@ -0,0 +1,110 @@
+#include "ComputePool.h"
+#include <algorithm>
+
+namespace
+{
+// Identifies the worker running on this thread, so nested submissions stay local
+thread_local ComputePool* currentPool = nullptr;
+thread_local size_t currentWorker = 0;
+} // namespace
+
+ComputePool::ComputePool(int numThreads)
+    : nextWorker_(0),
+      pending_(0),
+      sleepers_(0),
+      stopping_(false)
+{
+    for (int i = 0; i < std::max(numThreads, 1); ++i)
+    {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    // started once every deque exists, since any worker may steal from any other
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+        workers_[i]->thread = std::thread(&ComputePool::workerFunc, this, i);
+    }
+}
+
+ComputePool::~ComputePool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        stopping_ = true;
+    }
+    sleepCond_.notify_all();
+    for (const std::unique_ptr<Worker>& worker : workers_)
+    {
+        worker->thread.join();
+    }
+}
+
+void ComputePool::submit(Task task)
+{
+    size_t index = currentPool == this ? currentWorker : nextWorker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    {
+        std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+        workers_[index]->tasks.push_back(std::move(task));
+    }
+
+    // Pairs with the sleeper registering itself before it checks pending_: either it sees
+    // this task, or this sees it and the notify cannot slip in before its wait
+    pending_.fetch_add(1);
+    if (sleepers_.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        sleepCond_.notify_one();
+    }
+}
+
+bool ComputePool::take(size_t index, Task& task)
+{
+    {
+        Worker& own = *workers_[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back()); // newest first, its data is likely still in cache
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t n = 1; n < workers_.size(); ++n)
+    {
+        Worker& victim = *workers_[(index + n) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front()); // oldest, the owner is least likely to want it soon
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ComputePool::workerFunc(size_t index)
+{
+    currentPool = this;
+    currentWorker = index;
+
+    Task task;
+    while (true)
+    {
+        if (take(index, task))
+        {
+            pending_.fetch_sub(1);
+            task();
+            task = nullptr; // release captures before possibly sleeping
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        sleepers_.fetch_add(1);
+        sleepCond_.wait(lock, [this]() { return stopping_ || pending_.load() > 0; });
+        sleepers_.fetch_sub(1);
+        if (stopping_ && pending_.load() == 0)
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#include "ConnectionRegistry.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+#include <cassert>
+
+ConnectionRegistry::ConnectionRegistry(EventLoop* loop)
+    : loop_(loop),
+      size_(0)
+{
+}
+
+void ConnectionRegistry::add(const ConnectionPtr& conn)
+{
+    loop_->assertInLoopThread();
+    conn->setRegistryIndex(connections_.size());
+    connections_.push_back(conn);
+    size_.store(connections_.size(), std::memory_order_relaxed);
+}
+
+void ConnectionRegistry::remove(const ConnectionPtr& conn)
+{
+    loop_->assertInLoopThread();
+    size_t index = conn->registryIndex();
+    if (index >= connections_.size() || connections_[index] != conn)
+    {
+        return; // not registered, or already removed by takeAll()
+    }
+    // fill the hole with the last connection to keep the array dense
+    if (index != connections_.size() - 1)
+    {
+        connections_[index] = std::move(connections_.back());
+        connections_[index]->setRegistryIndex(index);
+    }
+    connections_.pop_back();
+    size_.store(connections_.size(), std::memory_order_relaxed);
+}
+
+void ConnectionRegistry::forEach(const Visitor& visitor) const
+{
+    loop_->assertInLoopThread();
+    // a copy, so the visitor may close connections while iterating
+    std::vector<ConnectionPtr> connections(connections_);
+    for (const ConnectionPtr& conn : connections)
+    {
+        visitor(conn);
+    }
+}
+
+std::vector<ConnectionRegistry::ConnectionPtr> ConnectionRegistry::takeAll()
+{
+    loop_->assertInLoopThread();
+    std::vector<ConnectionPtr> connections;
+    connections.swap(connections_);
+    size_.store(0, std::memory_order_relaxed);
+    return connections;
+}
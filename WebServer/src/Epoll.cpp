@@ -11,7 +11,8 @@ const int kDeleted = 2;
 
 Epoll::Epoll()
     : epollFd_(epoll_create1(EPOLL_CLOEXEC)),
-      events_(kInitEventListSize)
+      events_(kInitEventListSize),
+      underusedPolls_(0)
 {
     if (epollFd_ < 0)
     {
@@ -73,30 +74,30 @@ void Epoll::removeChannel(Channel* channel)
     channel->setIndex(kNew);
 }
 
-std::vector<Channel*> Epoll::poll(int timeoutMs)
+bool Epoll::hasChannel(Channel* channel) const
+{
+    return channel->index() == kAdded;
+}
+
+void Epoll::poll(int timeoutMs, ChannelList* activeChannels)
 {
     int numEvents = epoll_wait(epollFd_, &*events_.begin(), static_cast<int>(events_.size()), timeoutMs);
     int savedErrno = errno;
     
-    std::vector<Channel*> activeChannels;
-    
     if (numEvents > 0)
     {
         for (int i = 0; i < numEvents; ++i)
         {
             Channel* channel = static_cast<Channel*>(events_[i].data.ptr);
             channel->setRevents(events_[i].events);
-            activeChannels.push_back(channel);
-        }
-        
-        if (static_cast<size_t>(numEvents) == events_.size())
-        {
-            events_.resize(events_.size() * 2);
+            activeChannels->push_back(channel);
         }
+        adjustEventList(numEvents);
     }
     else if (numEvents == 0)
     {
         // Timeout
+        adjustEventList(0);
     }
     else
     {
@@ -105,6 +106,29 @@ std::vector<Channel*> Epoll::poll(int timeoutMs)
             perror("epoll_wait");
         }
     }
-    
-    return activeChannels;
+}
+
+void Epoll::adjustEventList(int numEvents)
+{
+    const size_t used = static_cast<size_t>(numEvents);
+    if (used == events_.size())
+    {
+        // Grow during a burst so the next epoll_wait can return everything at once
+        events_.resize(events_.size() * 2);
+        underusedPolls_ = 0;
+    }
+    else if (events_.size() > kInitEventListSize && used < events_.size() / 4)
+    {
+        // Give the memory back once the burst has been over for a while
+        if (++underusedPolls_ >= kShrinkAfterPolls)
+        {
+            events_.resize(events_.size() / 2);
+            events_.shrink_to_fit();
+            underusedPolls_ = 0;
+        }
+    }
+    else
+    {
+        underusedPolls_ = 0;
+    }
 }
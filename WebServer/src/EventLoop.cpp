@@ -1,17 +1,241 @@
+#include "EventLoop.h"
+#include "Channel.h"
+#include "Epoll.h"
+#include "IoUringPoller.h"
+#include "SlabPool.h"
+#include "Timer.h"
+#include "TimingWheel.h"
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
 
-void EventLoop::runAt(std::chrono::steady_clock::time_point time, std::function<void()> cb)
+const int kPollTimeMs = 10000;
+
+int createEventfd()
+{
+    int evtfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (evtfd < 0)
+    {
+        perror("eventfd");
+        abort();
+    }
+    return evtfd;
+}
+
+std::unique_ptr<Poller> createPoller(EventLoop::PollerType& type)
+{
+    if (type == EventLoop::kIoUring)
+    {
+        std::unique_ptr<IoUringPoller> poller = std::make_unique<IoUringPoller>();
+        if (poller->valid())
+        {
+            return poller;
+        }
+        type = EventLoop::kEpoll; // io_uring unavailable, fall back to epoll
+    }
+    return std::make_unique<Epoll>();
+}
+
+EventLoop::EventLoop(PollerType pollerType, int numaNode)
+    : looping_(false),
+      quit_(false),
+      eventHandling_(false),
+      callingPendingFunctors_(false),
+      threadId_(std::this_thread::get_id()),
+      pollerType_(pollerType),
+      numaNode_(numaNode),
+      poller_(createPoller(pollerType_)),
+      wakeupFd_(createEventfd()),
+      wakeupChannel_(std::make_unique<Channel>(this, wakeupFd_)),
+      timerQueue_(std::make_unique<TimerManager>(this)),
+      timingWheel_(std::make_unique<TimingWheel>(this)),
+      pool_(std::make_shared<SlabPool>(numaNode)),
+      wakeupPending_(false),
+      assignedConnections_(0),
+      pendingFunctorCount_(0),
+      busyMicros_(0)
+{
+    wakeupChannel_->setReadCallback(std::bind(&EventLoop::handleRead, this));
+    wakeupChannel_->enableReading();
+}
+
+EventLoop::~EventLoop()
+{
+    wakeupChannel_->disableAll();
+    wakeupChannel_->remove();
+    ::close(wakeupFd_);
+}
+
+void EventLoop::loop()
+{
+    assert(!looping_);
+    assertInLoopThread();
+    looping_ = true;
+    quit_ = false;
+
+    while (!quit_)
+    {
+        activeChannels_.clear(); // keeps capacity, so steady-state polling does not allocate
+        poller_->poll(kPollTimeMs, &activeChannels_);
+        auto busyStart = std::chrono::steady_clock::now();
+
+        eventHandling_ = true;
+        for (Channel* channel : activeChannels_)
+        {
+            channel->handleEvent();
+        }
+        eventHandling_ = false;
+
+        doPendingFunctors();
+
+        // exponential moving average over roughly the last eight iterations
+        int64_t busy = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - busyStart).count();
+        int64_t average = busyMicros_.load(std::memory_order_relaxed);
+        busyMicros_.store(average + (busy - average) / 8, std::memory_order_relaxed);
+    }
+
+    looping_ = false;
+}
+
+void EventLoop::quit()
+{
+    quit_ = true;
+    // the loop may be blocked in poll(), wake it up so it sees quit_
+    if (!isInLoopThread())
+    {
+        wakeup();
+    }
+}
+
+void EventLoop::runInLoop(Functor cb)
+{
+    if (isInLoopThread())
+    {
+        cb();
+    }
+    else
+    {
+        queueInLoop(std::move(cb));
+    }
+}
+
+void EventLoop::queueInLoop(Functor cb)
+{
+    pendingFunctors_.push(std::move(cb));
+    pendingFunctorCount_.fetch_add(1, std::memory_order_relaxed);
+
+    // the functors queued by doPendingFunctors() itself run in the next iteration.
+    // Only the first producer after a drain pays for the eventfd write.
+    if (!isInLoopThread() || callingPendingFunctors_)
+    {
+        if (!wakeupPending_.exchange(true))
+        {
+            wakeup();
+        }
+    }
+}
+
+
+TimerId EventLoop::runAt(std::chrono::steady_clock::time_point time, std::function<void()> cb)
 {
-    timerQueue_->addTimer(cb, time, 0.0);
+    return timerQueue_->addTimer(cb, time, 0.0);
 }
 
-void EventLoop::runAfter(double delay, std::function<void()> cb)
+TimerId EventLoop::runAfter(double delay, std::function<void()> cb)
 {
     auto time = std::chrono::steady_clock::now() + std::chrono::microseconds(static_cast<int64_t>(delay * 1000000));
-    runAt(time, cb);
+    return runAt(time, cb);
 }
 
-void EventLoop::runEvery(double interval, std::function<void()> cb)
+TimerId EventLoop::runEvery(double interval, std::function<void()> cb)
 {
     auto time = std::chrono::steady_clock::now() + std::chrono::microseconds(static_cast<int64_t>(interval * 1000000));
-    timerQueue_->addTimer(cb, time, interval);
+    return timerQueue_->addTimer(cb, time, interval);
+}
+
+void EventLoop::cancel(TimerId timerId)
+{
+    timerQueue_->cancel(timerId);
+}
+
+void EventLoop::restart(TimerId timerId, double delay)
+{
+    auto time = std::chrono::steady_clock::now() + std::chrono::microseconds(static_cast<int64_t>(delay * 1000000));
+    timerQueue_->restart(timerId, time);
+}
+
+void EventLoop::wakeup()
+{
+    uint64_t one = 1;
+    ssize_t n = ::write(wakeupFd_, &one, sizeof one);
+    if (n != sizeof one)
+    {
+        perror("EventLoop::wakeup");
+    }
+}
+
+void EventLoop::handleRead()
+{
+    uint64_t one = 1;
+    ssize_t n = ::read(wakeupFd_, &one, sizeof one);
+    if (n != sizeof one)
+    {
+        perror("EventLoop::handleRead");
+    }
+}
+
+void EventLoop::doPendingFunctors()
+{
+    callingPendingFunctors_ = true;
+
+    // Cleared before draining: a producer that finds the flag set has already
+    // finished its push, so its functor is part of this batch.
+    wakeupPending_.store(false);
+
+    // Drain into a batch first so functors queued while running wait for the next iteration
+    Functor functor;
+    while (pendingFunctors_.pop(functor))
+    {
+        runningFunctors_.push_back(std::move(functor));
+    }
+
+    pendingFunctorCount_.fetch_sub(static_cast<int>(runningFunctors_.size()), std::memory_order_relaxed);
+    for (const Functor& f : runningFunctors_)
+    {
+        f();
+    }
+    runningFunctors_.clear();
+    callingPendingFunctors_ = false;
+}
+
+void EventLoop::updateChannel(Channel* channel)
+{
+    assert(channel->ownerLoop() == this);
+    assertInLoopThread();
+    poller_->updateChannel(channel);
+}
+
+void EventLoop::removeChannel(Channel* channel)
+{
+    assert(channel->ownerLoop() == this);
+    assertInLoopThread();
+    poller_->removeChannel(channel);
+}
+
+bool EventLoop::hasChannel(Channel* channel)
+{
+    assert(channel->ownerLoop() == this);
+    assertInLoopThread();
+    return poller_->hasChannel(channel);
+}
+
+void EventLoop::assertInLoopThread()
+{
+    if (!isInLoopThread())
+    {
+        fprintf(stderr, "EventLoop::assertInLoopThread - EventLoop was created in another thread\n");
+        abort();
+    }
 }
@@ -1,9 +1,75 @@
 #include "EventLoopThread.h"
 #include "EventLoop.h"
+#include <dirent.h>
+#include <sched.h>
 #include <assert.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
 
-EventLoopThread::EventLoopThread()
+namespace
+{
+// Node of a CPU from sysfs (the cpuN directory links to its nodeM), -1 if unknown
+int numaNodeOfCpu(int cpu)
+{
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR* dir = opendir(path.c_str());
+    if (!dir)
+    {
+        return -1;
+    }
+    int node = -1;
+    while (struct dirent* entry = readdir(dir))
+    {
+        if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+        {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+// The node all the CPUs share, -1 if they span several
+int numaNodeOf(const EventLoopThread::CpuSet& cpus)
+{
+    int node = numaNodeOfCpu(cpus.front());
+    for (int cpu : cpus)
+    {
+        if (numaNodeOfCpu(cpu) != node)
+        {
+            return -1;
+        }
+    }
+    return node;
+}
+
+bool pinCurrentThread(const EventLoopThread::CpuSet& cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+    {
+        if (cpu >= 0 && cpu < CPU_SETSIZE)
+        {
+            CPU_SET(cpu, &set);
+        }
+    }
+    if (sched_setaffinity(0, sizeof set, &set) < 0)
+    {
+        perror("sched_setaffinity");
+        return false;
+    }
+    return true;
+}
+} // namespace
+
+EventLoopThread::EventLoopThread(EventLoop::PollerType pollerType, const CpuSet& cpus)
     : loop_(nullptr),
+      pollerType_(pollerType),
+      cpus_(cpus),
       exiting_(false)
 {
 }
@@ -35,7 +101,13 @@ EventLoop* EventLoopThread::startLoop()
 
 void EventLoopThread::threadFunc()
 {
-    EventLoop loop;
+    // Pinned before the loop exists, so everything it allocates is first touched on its node
+    int numaNode = -1;
+    if (!cpus_.empty() && pinCurrentThread(cpus_))
+    {
+        numaNode = numaNodeOf(cpus_);
+    }
+    EventLoop loop(pollerType_, numaNode);
 
     {
         std::unique_lock<std::mutex> lock(mutex_);
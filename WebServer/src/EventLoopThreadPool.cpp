@@ -1,13 +1,31 @@
 #include "EventLoopThreadPool.h"
 #include "EventLoopThread.h"
 #include "EventLoop.h"
+#include "InetAddress.h"
+#include <sched.h>
+#include <sys/socket.h>
 #include <assert.h>
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+// splitmix64 finalizer: spreads ring points and keys evenly over 64 bits
+uint64_t mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+} // namespace
 
 EventLoopThreadPool::EventLoopThreadPool(EventLoop* baseLoop, int numThreads)
     : baseLoop_(baseLoop),
       started_(false),
       numThreads_(numThreads),
-      next_(0)
+      next_(0),
+      policy_(kRoundRobin)
 {
 }
 
@@ -24,7 +42,9 @@ void EventLoopThreadPool::start()
 
     for (int i = 0; i < numThreads_; ++i)
     {
-        std::unique_ptr<EventLoopThread> t = std::make_unique<EventLoopThread>();
+        // I/O loops use the same poller backend as the base loop
+        EventLoopThread::CpuSet cpus = cpus_.empty() ? EventLoopThread::CpuSet() : cpus_[i % cpus_.size()];
+        std::unique_ptr<EventLoopThread> t = std::make_unique<EventLoopThread>(baseLoop_->pollerType(), cpus);
         loops_.push_back(t->startLoop());
         threads_.push_back(std::move(t));
     }
@@ -34,6 +54,55 @@ void EventLoopThreadPool::start()
         // No threads, everything in baseLoop
         // loops_.push_back(baseLoop_); // Optional: depending on policy
     }
+
+    for (EventLoop* loop : loops_)
+    {
+        int cpu = pinnedCpu(loop);
+        if (cpu >= 0)
+        {
+            if (static_cast<size_t>(cpu) >= cpuLoops_.size())
+            {
+                cpuLoops_.resize(cpu + 1, nullptr);
+            }
+            if (!cpuLoops_[cpu])
+            {
+                cpuLoops_[cpu] = loop;
+            }
+        }
+    }
+
+    if (policy_ == kConsistentHash)
+    {
+        buildRing();
+    }
+}
+
+void EventLoopThreadPool::setSelectionPolicy(SelectionPolicy policy)
+{
+    policy_ = policy;
+    if (started_)
+    {
+        // the loops exist by now, so a switch to hashing needs its ring right away
+        baseLoop_->assertInLoopThread();
+        if (policy_ == kConsistentHash && ring_.empty())
+        {
+            buildRing();
+        }
+    }
+}
+
+void EventLoopThreadPool::buildRing()
+{
+    // points depend on the loop's index only, so a restart maps clients the same way
+    ring_.clear();
+    for (size_t i = 0; i < loops_.size(); ++i)
+    {
+        for (int v = 0; v < kVirtualNodes; ++v)
+        {
+            ring_.emplace_back(mix((static_cast<uint64_t>(i) << 32) | v), loops_[i]);
+        }
+    }
+    std::sort(ring_.begin(), ring_.end());
 }
 
 EventLoop* EventLoopThreadPool::getNextLoop()
@@ -53,3 +122,143 @@ EventLoop* EventLoopThreadPool::getNextLoop()
     }
     return loop;
 }
+
+std::vector<EventLoopThread::CpuSet> EventLoopThreadPool::cpuPerLoop()
+{
+    std::vector<EventLoopThread::CpuSet> cpus;
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof set, &set) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &set))
+            {
+                cpus.push_back(EventLoopThread::CpuSet(1, cpu));
+            }
+        }
+    }
+    return cpus;
+}
+
+int EventLoopThreadPool::pinnedCpu(EventLoop* loop) const
+{
+    for (size_t i = 0; i < loops_.size() && !cpus_.empty(); ++i)
+    {
+        if (loops_[i] == loop)
+        {
+            const EventLoopThread::CpuSet& cpus = cpus_[i % cpus_.size()];
+            return cpus.size() == 1 ? cpus.front() : -1;
+        }
+    }
+    return -1;
+}
+
+EventLoop* EventLoopThreadPool::getLoopForConnection(int sockfd, const InetAddress& peerAddr)
+{
+    baseLoop_->assertInLoopThread();
+    assert(started_);
+    EventLoop* loop = baseLoop_;
+
+    if (!loops_.empty())
+    {
+        if (selector_)
+        {
+            loop = selectedLoop(peerAddr);
+        }
+        else
+        {
+            switch (policy_)
+            {
+            case kLeastConnections:
+                loop = leastLoaded([](EventLoop* l) { return static_cast<int64_t>(l->assignedConnections()); });
+                break;
+            case kLeastPending:
+                loop = leastLoaded([](EventLoop* l) { return static_cast<int64_t>(l->pendingFunctorCount()); });
+                break;
+            case kLeastLatency:
+                // the average only moves when the loop runs, so an emptied loop could keep a stale one
+                loop = leastLoaded([](EventLoop* l) { return l->assignedConnections() > 0 ? l->busyMicros() : 0; });
+                break;
+            case kConsistentHash:
+                loop = hashedLoop(peerAddr);
+                break;
+            case kIncomingCpu:
+                loop = incomingCpuLoop(sockfd);
+                if (!loop)
+                {
+                    loop = leastLoaded([](EventLoop* l) { return static_cast<int64_t>(l->assignedConnections()); });
+                }
+                break;
+            default:
+                loop = getNextLoop();
+                break;
+            }
+        }
+    }
+    loop->adjustAssignedConnections(1);
+    return loop;
+}
+
+template <typename Score>
+EventLoop* EventLoopThreadPool::leastLoaded(Score score)
+{
+    size_t best = next_;
+    int64_t bestScore = score(loops_[best]);
+    for (size_t n = 1; n < loops_.size(); ++n)
+    {
+        size_t i = (next_ + n) % loops_.size();
+        int64_t s = score(loops_[i]);
+        if (s < bestScore)
+        {
+            best = i;
+            bestScore = s;
+        }
+    }
+    next_ = static_cast<int>((best + 1) % loops_.size());
+    return loops_[best];
+}
+
+EventLoop* EventLoopThreadPool::selectedLoop(const InetAddress& peerAddr)
+{
+    // the connection would be run by, and counted against, whatever loop comes back
+    EventLoop* loop = selector_(loops_, peerAddr);
+    if (!loop || std::find(loops_.begin(), loops_.end(), loop) == loops_.end())
+    {
+        std::cerr << "EventLoopThreadPool: loop selector returned a loop outside the pool, using round-robin" << std::endl;
+        return getNextLoop();
+    }
+    return loop;
+}
+
+EventLoop* EventLoopThreadPool::hashedLoop(const InetAddress& peerAddr) const
+{
+    uint64_t key = mix(peerAddr.ipHash());
+    auto it = std::lower_bound(ring_.begin(), ring_.end(), std::make_pair(key, static_cast<EventLoop*>(nullptr)));
+    if (it == ring_.end())
+    {
+        it = ring_.begin(); // wrap around the ring
+    }
+    return it->second;
+}
+
+EventLoop* EventLoopThreadPool::incomingCpuLoop(int sockfd) const
+{
+    // the CPU whose softirq handled the connection's packets, i.e. where its RX queue is served
+    int cpu = -1;
+    socklen_t len = sizeof cpu;
+    if (getsockopt(sockfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) < 0 || cpu < 0 || static_cast<size_t>(cpu) >= cpuLoops_.size())
+    {
+        return nullptr;
+    }
+    return cpuLoops_[cpu];
+}
+
+std::vector<EventLoop*> EventLoopThreadPool::getAllLoops()
+{
+    assert(started_);
+    if (loops_.empty())
+    {
+        return std::vector<EventLoop*>(1, baseLoop_);
+    }
+    return loops_;
+}
@@ -0,0 +1,129 @@
+#include "FileCache.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+
+FileCache::FileCache(size_t maxEntries, double ttlSeconds)
+    : maxEntries_(maxEntries),
+      ttl_(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(ttlSeconds)))
+{
+}
+
+FileCache& FileCache::instance()
+{
+    static FileCache cache;
+    return cache;
+}
+
+FileCache::EntryPtr FileCache::lookup(const std::string& path)
+{
+    Clock::time_point now = Clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(path);
+        if (it != entries_.end())
+        {
+            if (now < it->second.entry->expires)
+            {
+                lru_.splice(lru_.begin(), lru_, it->second.lruPos);
+                return it->second.entry;
+            }
+            lru_.erase(it->second.lruPos);
+            entries_.erase(it);
+        }
+    }
+
+    // Syscalls happen outside the lock; two threads missing on the same path both load it
+    EntryPtr entry = load(path, now);
+    if (!entry)
+    {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(path);
+    if (it != entries_.end())
+    {
+        it->second.entry = entry;
+        lru_.splice(lru_.begin(), lru_, it->second.lruPos);
+    }
+    else
+    {
+        lru_.push_front(path);
+        entries_[path] = Slot{entry, lru_.begin()};
+        while (entries_.size() > maxEntries_)
+        {
+            entries_.erase(lru_.back());
+            lru_.pop_back();
+        }
+    }
+    return entry;
+}
+
+FileCache::EntryPtr FileCache::load(const std::string& path, Clock::time_point now)
+{
+    char resolvedPath[PATH_MAX];
+    if (realpath(path.c_str(), resolvedPath) == nullptr)
+    {
+        return nullptr;
+    }
+
+    // stat before opening: open() on a FIFO blocks until a writer shows up, stalling the loop
+    auto entry = std::make_shared<Entry>();
+    if (stat(resolvedPath, &entry->st) < 0)
+    {
+        return nullptr;
+    }
+    entry->resolvedPath = resolvedPath;
+    entry->expires = now + ttl_;
+    if (S_ISDIR(entry->st.st_mode))
+    {
+        return entry; // metadata only, for directory checks
+    }
+    if (!S_ISREG(entry->st.st_mode))
+    {
+        errno = EACCES;
+        return nullptr;
+    }
+
+    // O_NONBLOCK in case the path was replaced by a FIFO since the stat
+    int fd = open(resolvedPath, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    auto file = std::make_shared<const OpenFile>(fd);
+
+    // fstat on the open fd: the metadata matches the file that will be sent
+    if (fstat(fd, &entry->st) < 0)
+    {
+        return nullptr;
+    }
+    if (!S_ISREG(entry->st.st_mode))
+    {
+        errno = EACCES;
+        return nullptr;
+    }
+    entry->file = file;
+    return entry;
+}
+
+void FileCache::invalidate(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(path);
+    if (it != entries_.end())
+    {
+        lru_.erase(it->second.lruPos);
+        entries_.erase(it);
+    }
+}
+
+void FileCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    lru_.clear();
+}
@@ -0,0 +1,170 @@
+#include "FileReceiver.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+
+FileReceiver::FileReceiver(const std::shared_ptr<const OpenFile>& file, off_t offset, size_t len)
+    : file_(file),
+      offset_(offset),
+      total_(len),
+      socketRemaining_(len),
+      pipeBytes_(0),
+      pipeCapacity_(0),
+      pipeFds_{-1, -1},
+      useSplice_(openPipe())
+{
+}
+
+FileReceiver::~FileReceiver()
+{
+    if (pipeFds_[0] >= 0)
+    {
+        close(pipeFds_[0]);
+        close(pipeFds_[1]);
+    }
+}
+
+bool FileReceiver::openPipe()
+{
+    if (pipe2(pipeFds_, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        perror("FileReceiver pipe2");
+        pipeFds_[0] = pipeFds_[1] = -1;
+        return false;
+    }
+    // A larger pipe means fewer splice calls per megabyte; failing just keeps the default
+    fcntl(pipeFds_[1], F_SETPIPE_SZ, kPipeSize);
+    int size = fcntl(pipeFds_[1], F_GETPIPE_SZ);
+    pipeCapacity_ = size > 0 ? size : 65536;
+    return true;
+}
+
+bool FileReceiver::write(const char* data, size_t len)
+{
+    len = std::min(len, socketRemaining_);
+    while (len > 0)
+    {
+        ssize_t n = pwrite(file_->fd(), data, len, offset_);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("FileReceiver pwrite");
+            return false;
+        }
+        data += n;
+        len -= n;
+        offset_ += n;
+        socketRemaining_ -= n;
+    }
+    return true;
+}
+
+ssize_t FileReceiver::receive(int sockfd, int* savedErrno)
+{
+    return useSplice_ ? receiveSplice(sockfd, savedErrno) : receiveCopy(sockfd, savedErrno);
+}
+
+ssize_t FileReceiver::receiveSplice(int sockfd, int* savedErrno)
+{
+    size_t moved = 0;
+    bool socketDrained = false;
+    while (!done() && moved < kMaxBytesPerCall && !(socketDrained && pipeBytes_ == 0))
+    {
+        // socket -> pipe, never more than the pipe can take
+        if (!socketDrained && socketRemaining_ > 0 && pipeBytes_ < pipeCapacity_)
+        {
+            size_t want = std::min(socketRemaining_, pipeCapacity_ - pipeBytes_);
+            ssize_t n = splice(sockfd, nullptr, pipeFds_[1], nullptr, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0)
+            {
+                pipeBytes_ += n;
+                socketRemaining_ -= n;
+            }
+            else if (n == 0)
+            {
+                return 0; // peer closed mid-body
+            }
+            else if (errno == EAGAIN)
+            {
+                socketDrained = true;
+            }
+            else if (errno == EINVAL && moved == 0 && pipeBytes_ == 0)
+            {
+                useSplice_ = false; // splice not supported here, copy through user space instead
+                return receiveCopy(sockfd, savedErrno);
+            }
+            else if (errno != EINTR)
+            {
+                *savedErrno = errno;
+                return -1;
+            }
+        }
+
+        // pipe -> file; a regular file blocks instead of returning a short count when busy
+        if (pipeBytes_ > 0)
+        {
+            ssize_t n = splice(pipeFds_[0], nullptr, file_->fd(), &offset_, pipeBytes_, SPLICE_F_MOVE);
+            if (n > 0)
+            {
+                pipeBytes_ -= n;
+                moved += n;
+            }
+            else if (n < 0 && errno != EINTR)
+            {
+                *savedErrno = errno;
+                return -1;
+            }
+        }
+    }
+
+    if (moved == 0 && !done())
+    {
+        *savedErrno = EAGAIN;
+        return -1;
+    }
+    return moved;
+}
+
+ssize_t FileReceiver::receiveCopy(int sockfd, int* savedErrno)
+{
+    char buf[65536];
+    size_t moved = 0;
+    while (socketRemaining_ > 0 && moved < kMaxBytesPerCall)
+    {
+        ssize_t n = read(sockfd, buf, std::min(sizeof buf, socketRemaining_));
+        if (n > 0)
+        {
+            if (!write(buf, n))
+            {
+                *savedErrno = errno;
+                return -1;
+            }
+            moved += n;
+        }
+        else if (n == 0)
+        {
+            return 0;
+        }
+        else if (errno == EAGAIN)
+        {
+            break;
+        }
+        else if (errno != EINTR)
+        {
+            *savedErrno = errno;
+            return -1;
+        }
+    }
+
+    if (moved == 0 && !done())
+    {
+        *savedErrno = EAGAIN;
+        return -1;
+    }
+    return moved;
+}
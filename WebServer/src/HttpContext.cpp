@@ -1,21 +1,49 @@
 #include "HttpContext.h"
+#include "CharScan.h"
 #include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <strings.h>
 
-bool HttpContext::parseRequest(Buffer* buf, int64_t receiveTime)
+bool HttpContext::parseRequest(Buffer* buf, [[maybe_unused]] int64_t receiveTime)
 {
+    if (state_ == kError)
+    {
+        return false;
+    }
+
     bool ok = true;
     bool hasMore = true;
+
+    // kCopy retrieves each line as soon as it is parsed; kView leaves the request in the
+    // buffer and advances parsed_ instead, so views into it stay valid
+    buf_ = buf;
+    base_ = buf->peek();
+
     while (hasMore)
     {
+        // Re-read both ends every time: in kCopy mode draining the buffer rewinds its indices
+        const char* start = buf->peek() + parsed_;
+        const char* end = buf->beginWrite();
         if (state_ == kExpectRequestLine)
         {
-            const char* crlf = std::search(buf->peek(), buf->beginWrite(), "\r\n", "\r\n" + 2);
-            if (crlf < buf->beginWrite())
+            const char* crlf = findLineEnd(start, end);
+            if (crlf == nullptr)
+            {
+                ok = failIf(end - start > static_cast<ptrdiff_t>(kMaxRequestLine), kUriTooLong);
+                hasMore = false;
+            }
+            else if (crlf - start > static_cast<ptrdiff_t>(kMaxRequestLine))
             {
-                ok = processRequestLine(buf->peek(), crlf);
+                ok = failIf(true, kUriTooLong);
+                hasMore = false;
+            }
+            else
+            {
+                ok = failIf(!processRequestLine(start, crlf), kBadRequest);
                 if (ok)
                 {
-                    buf->retrieve(crlf + 2 - buf->peek());
+                    advance(buf, crlf + 2 - start);
                     state_ = kExpectHeaders;
                 }
                 else
@@ -23,64 +51,406 @@ bool HttpContext::parseRequest(Buffer* buf, int64_t receiveTime)
                     hasMore = false;
                 }
             }
+        }
+        else if (state_ == kExpectHeaders || state_ == kExpectTrailers)
+        {
+            const char* crlf = findLineEnd(start, end);
+            size_t lineLen = (crlf ? crlf : end) - start;
+            if (lineLen > kMaxHeaderLine || headerBytes_ + lineLen > kMaxHeaderBytes)
+            {
+                ok = failIf(true, kHeaderTooLarge);
+                hasMore = false;
+            }
+            else if (crlf == nullptr)
+            {
+                hasMore = false;
+            }
+            else if (crlf == start)
+            {
+                // Empty line, end of headers or trailers
+                advance(buf, 2);
+                if (state_ == kExpectHeaders)
+                {
+                    ok = startBody(buf);
+                }
+                else
+                {
+                    state_ = kGotAll;
+                }
+                hasMore = ok && state_ != kGotAll;
+            }
             else
             {
+                const char* colon = findChar(start, crlf, ':');
+                if (colon == crlf)
+                {
+                    ok = failIf(true, kBadRequest);
+                    hasMore = false;
+                }
+                else if (++headerLines_ > kMaxHeaders)
+                {
+                    ok = failIf(true, kHeaderTooLarge);
+                    hasMore = false;
+                }
+                else
+                {
+                    // trailer fields are checked against the limits but not kept
+                    if (state_ == kExpectHeaders)
+                    {
+                        addHeader(start, colon, crlf);
+                    }
+                    headerBytes_ += lineLen + 2;
+                    advance(buf, lineLen + 2);
+                }
+            }
+        }
+        else if (state_ == kExpectBody)
+        {
+            size_t available = end - start;
+            if (viewing() && !streamBody_)
+            {
+                // wait for the whole body and hand it out as a view into the Buffer
+                if (available >= bodyRemaining_)
+                {
+                    bodyRange_ = toRange(start, start + bodyRemaining_);
+                    bodyInBuffer_ = true;
+                    bodyBytes_ = bodyRemaining_;
+                    advance(buf, bodyRemaining_);
+                    bodyRemaining_ = 0;
+                    state_ = kGotAll;
+                }
+                hasMore = false;
+            }
+            else
+            {
+                size_t len = std::min(available, bodyRemaining_);
+                if (len > 0)
+                {
+                    bodyRemaining_ -= len;
+                    deliverBody(buf, start, len);
+                }
+                if (bodyRemaining_ == 0)
+                {
+                    state_ = kGotAll;
+                }
                 hasMore = false;
             }
         }
-        else if (state_ == kExpectHeaders)
+        else if (state_ == kExpectChunkSize)
         {
-            const char* crlf = std::search(buf->peek(), buf->beginWrite(), "\r\n", "\r\n" + 2);
-            if (crlf < buf->beginWrite())
+            const char* crlf = findLineEnd(start, end);
+            if (crlf == nullptr)
             {
-                const char* colon = std::find(buf->peek(), crlf, ':');
-                if (colon != crlf)
+                ok = failIf(end - start > static_cast<ptrdiff_t>(kMaxHeaderLine), kBadRequest);
+                hasMore = false;
+            }
+            else
+            {
+                ok = parseChunkSize(start, crlf);
+                if (ok)
                 {
-                    addHeader(buf->peek(), colon, crlf);
+                    advance(buf, crlf + 2 - start);
+                    state_ = bodyRemaining_ > 0 ? kExpectChunkData : kExpectTrailers;
                 }
                 else
                 {
-                    // Empty line, end of headers
-                    state_ = kGotAll;
                     hasMore = false;
                 }
-                buf->retrieve(crlf + 2 - buf->peek());
+            }
+        }
+        else if (state_ == kExpectChunkData)
+        {
+            size_t len = std::min(static_cast<size_t>(end - start), bodyRemaining_);
+            if (len == 0)
+            {
+                hasMore = false;
+            }
+            else if (!streamBody_ && bodyCallback_ && bodyBytes_ + len > inlineBodyLimit_)
+            {
+                // The body outgrew the inline limit: pass what was collected to the
+                // callback and stream the rest
+                detachFromBuffer(buf);
+                streamBody_ = true;
+                if (!body_.empty())
+                {
+                    bodyCallback_(*this, body_);
+                    body_.clear();
+                }
             }
             else
+            {
+                bodyRemaining_ -= len;
+                deliverBody(buf, start, len);
+                if (bodyRemaining_ == 0)
+                {
+                    state_ = kExpectChunkEnd;
+                }
+            }
+        }
+        else if (state_ == kExpectChunkEnd)
+        {
+            if (end - start < 2)
             {
                 hasMore = false;
             }
+            else
+            {
+                ok = failIf(start[0] != '\r' || start[1] != '\n', kBadRequest);
+                if (ok)
+                {
+                    advance(buf, 2);
+                    state_ = kExpectChunkSize;
+                }
+                else
+                {
+                    hasMore = false;
+                }
+            }
         }
-        else if (state_ == kExpectBody)
+        else
         {
-            // TODO: Handle body (for POST)
-            state_ = kGotAll;
             hasMore = false;
         }
     }
     return ok;
 }
 
+bool HttpContext::startBody(Buffer* buf)
+{
+    std::string_view transferEncoding = headerView("Transfer-Encoding");
+    std::string_view contentLength = headerView("Content-Length");
+    if (!failIf(lengthConflict_, kBadRequest))
+    {
+        return false;
+    }
+    if (!transferEncoding.empty())
+    {
+        // Both framings at once is the classic request smuggling vector, refuse it
+        if (!failIf(lengthFields_ > 0, kBadRequest))
+        {
+            return false;
+        }
+        if (!failIf(transferEncoding.size() != 7 || strncasecmp(transferEncoding.data(), "chunked", 7) != 0, kNotImplemented))
+        {
+            return false;
+        }
+        state_ = kExpectChunkSize;
+        return true;
+    }
+
+    if (lengthFields_ == 0)
+    {
+        state_ = kGotAll;
+        return true;
+    }
+    if (!failIf(contentLength.empty(), kBadRequest))
+    {
+        return false;
+    }
+
+    size_t length = 0;
+    for (char c : contentLength)
+    {
+        if (!failIf(c < '0' || c > '9', kBadRequest) || !failIf(length > (SIZE_MAX - 9) / 10, kBodyTooLarge))
+        {
+            return false;
+        }
+        length = length * 10 + (c - '0');
+    }
+    if (length == 0)
+    {
+        state_ = kGotAll;
+        return true;
+    }
+
+    // A handed-off body never enters the Buffer, so maxBodySize does not apply to it
+    contentLength_ = length;
+    if (bodyHandoff_ && bodyHandoff_(*this))
+    {
+        detachFromBuffer(buf);
+        handedOff_ = true;
+        state_ = kGotAll;
+        return true;
+    }
+    if (!failIf(length > maxBodySize_, kBodyTooLarge))
+    {
+        return false;
+    }
+    bodyRemaining_ = length;
+    if (bodyCallback_ && length > inlineBodyLimit_)
+    {
+        detachFromBuffer(buf);
+        streamBody_ = true;
+    }
+    state_ = kExpectBody;
+    return true;
+}
+
+bool HttpContext::parseChunkSize(const char* start, const char* end)
+{
+    size_t size = 0;
+    int digits = 0;
+    const char* p = start;
+    for (; p < end && isxdigit(static_cast<unsigned char>(*p)); ++p)
+    {
+        if (!failIf(++digits > 15, kBodyTooLarge))
+        {
+            return false;
+        }
+        size = size * 16 + (isdigit(static_cast<unsigned char>(*p)) ? *p - '0' : (tolower(*p) - 'a' + 10));
+    }
+    while (p < end && (*p == ' ' || *p == '\t'))
+    {
+        ++p;
+    }
+    // chunk extensions after ';' are ignored
+    if (!failIf(digits == 0 || (p != end && *p != ';'), kBadRequest))
+    {
+        return false;
+    }
+    if (!failIf(bodyBytes_ + size > maxBodySize_, kBodyTooLarge))
+    {
+        return false;
+    }
+    bodyRemaining_ = size;
+    return true;
+}
+
+void HttpContext::deliverBody(Buffer* buf, const char* data, size_t len)
+{
+    bodyBytes_ += len;
+    if (streamBody_)
+    {
+        bodyCallback_(*this, std::string_view(data, len));
+    }
+    else
+    {
+        body_.append(data, len);
+    }
+    advance(buf, len);
+}
+
+void HttpContext::detachFromBuffer(Buffer* buf)
+{
+    // A streamed body is retrieved from the Buffer piece by piece, which needs the
+    // request line and headers in front of it gone: copy them out first
+    if (!viewing())
+    {
+        return;
+    }
+    path_.assign(pathView());
+    query_.assign(queryView());
+    for (const auto& header : headerRanges_)
+    {
+        headers_[std::string(view(header.first))] = std::string(view(header.second));
+    }
+    detached_ = true;
+    buf->retrieve(parsed_);
+    parsed_ = 0;
+}
+
+void HttpContext::reset()
+{
+    state_ = kExpectRequestLine;
+    detached_ = false;
+    error_ = kNoError;
+    scanned_ = 0;
+    headerLines_ = 0;
+    headerBytes_ = 0;
+    method_ = kInvalid;
+    version_ = kUnknown;
+    path_.clear();
+    query_.clear();
+    headers_.clear();
+    pathRange_ = Range();
+    queryRange_ = Range();
+    headerRanges_.clear(); // keeps capacity, so the next request does not allocate
+    contentLength_ = 0;
+    lengthFields_ = 0;
+    lengthConflict_ = false;
+    handedOff_ = false;
+    bodyRemaining_ = 0;
+    bodyBytes_ = 0;
+    bodyInBuffer_ = false;
+    streamBody_ = false;
+    bodyRange_ = Range();
+    if (body_.capacity() > inlineBodyLimit_)
+    {
+        std::string().swap(body_); // do not pin the memory of an unusually large body
+    }
+    body_.clear();
+    buf_ = nullptr;
+    parsed_ = 0;
+}
+
+void HttpContext::consume(Buffer* buf)
+{
+    if (viewing() && parsed_ > 0)
+    {
+        buf->retrieve(parsed_);
+    }
+    reset();
+}
+
+const char* HttpContext::findLineEnd(const char* start, const char* end)
+{
+    // Resume after the bytes an earlier call already searched, so a line trickling in
+    // over many reads is scanned once in total
+    const char* crlf = findCRLF(start + scanned_, end);
+    if (crlf == end)
+    {
+        // the last byte may be a CR whose LF has not arrived yet
+        scanned_ = end > start ? end - start - 1 : 0;
+        return nullptr;
+    }
+    scanned_ = 0;
+    return crlf;
+}
+
+void HttpContext::advance(Buffer* buf, size_t len)
+{
+    if (viewing())
+    {
+        parsed_ += len;
+    }
+    else
+    {
+        buf->retrieve(len);
+    }
+}
+
+bool HttpContext::failIf(bool failed, ParseError error)
+{
+    if (failed)
+    {
+        error_ = error;
+        state_ = kError;
+    }
+    return !failed;
+}
+
 bool HttpContext::processRequestLine(const char* begin, const char* end)
 {
     bool succeed = false;
     const char* start = begin;
-    const char* space = std::find(start, end, ' ');
+    const char* space = findChar(start, end, ' ');
     if (space != end && method_ == kInvalid)
     {
-        std::string m(start, space);
+        std::string_view m(start, space - start);
         if (m == "GET") method_ = kGet;
         else if (m == "POST") method_ = kPost;
         else if (m == "HEAD") method_ = kHead;
+        else if (m == "PUT") method_ = kPut;
+        else if (m == "DELETE") method_ = kDelete;
         else method_ = kInvalid;
         
         if (method_ != kInvalid)
         {
             start = space + 1;
-            space = std::find(start, end, ' ');
+            space = findChar(start, end, ' ');
             if (space != end)
             {
-                const char* question = std::find(start, space, '?');
+                const char* question = findChar(start, space, '?');
                 if (question != space)
                 {
                     setPath(start, question);
@@ -92,7 +462,7 @@ bool HttpContext::processRequestLine(const char* begin, const char* end)
                 }
                 
                 start = space + 1;
-                std::string v(start, end);
+                std::string_view v(start, end - start);
                 if (v == "HTTP/1.0") version_ = kHttp10;
                 else if (v == "HTTP/1.1") version_ = kHttp11;
                 else version_ = kUnknown;
@@ -104,20 +474,63 @@ bool HttpContext::processRequestLine(const char* begin, const char* end)
     return succeed;
 }
 
+void HttpContext::setPath(const char* start, const char* end)
+{
+    if (viewing())
+    {
+        pathRange_ = toRange(start, end);
+    }
+    else
+    {
+        path_.assign(start, end);
+    }
+}
+
+void HttpContext::setQuery(const char* start, const char* end)
+{
+    if (viewing())
+    {
+        queryRange_ = toRange(start, end);
+    }
+    else
+    {
+        query_.assign(start, end);
+    }
+}
+
 void HttpContext::addHeader(const char* start, const char* colon, const char* end)
 {
-    std::string field(start, colon);
+    const char* fieldEnd = colon;
     ++colon;
     while (colon < end && isspace(*colon))
     {
         ++colon;
     }
-    std::string value(colon, end);
-    while (!value.empty() && isspace(value[value.size()-1]))
+    const char* valueEnd = end;
+    while (valueEnd > colon && isspace(valueEnd[-1]))
     {
-        value.resize(value.size()-1);
+        --valueEnd;
+    }
+
+    // Checked before the field is stored, while the earlier value is still there: with
+    // differing lengths, which one frames the body depends on the parser, a smuggling vector
+    if (fieldEnd - start == 14 && strncasecmp(start, "Content-Length", 14) == 0)
+    {
+        if (lengthFields_ > 0 && headerView("Content-Length") != std::string_view(colon, valueEnd - colon))
+        {
+            lengthConflict_ = true;
+        }
+        ++lengthFields_;
+    }
+
+    if (viewing())
+    {
+        headerRanges_.emplace_back(toRange(start, fieldEnd), toRange(colon, valueEnd));
+    }
+    else
+    {
+        headers_[std::string(start, fieldEnd)] = std::string(colon, valueEnd);
     }
-    headers_[field] = value;
 }
 
 const std::string& HttpContext::getHeader(const std::string& key) const
@@ -130,3 +543,32 @@ const std::string& HttpContext::getHeader(const std::string& key) const
     static const std::string empty;
     return empty;
 }
+
+std::string_view HttpContext::headerView(std::string_view key) const
+{
+    auto sameField = [key](std::string_view field) {
+        return field.size() == key.size() && strncasecmp(field.data(), key.data(), key.size()) == 0;
+    };
+
+    if (viewing())
+    {
+        for (const auto& header : headerRanges_)
+        {
+            if (sameField(view(header.first)))
+            {
+                return view(header.second);
+            }
+        }
+    }
+    else
+    {
+        for (const auto& header : headers_)
+        {
+            if (sameField(header.first))
+            {
+                return header.second;
+            }
+        }
+    }
+    return std::string_view();
+}
@@ -1,13 +1,40 @@
 #include "HttpData.h"
 
+size_t HttpData::findLineEnd(size_t maxLen)
+{
+    // Resume where the previous call gave up, so a line trickling in over many reads
+    // has each of its bytes searched once. Never look further than a line of maxLen
+    // bytes could reach; the caller rejects the line once more than that is buffered
+    const char* data = inBuffer_.data();
+    size_t limit = std::min(inBuffer_.size(), static_cast<size_t>(readIdx_) + maxLen + 2);
+    const char* end = data + limit;
+    size_t from = std::max(scanIdx_, static_cast<size_t>(readIdx_));
+    const char* crlf = findCRLF(data + std::min(from, limit), end);
+    if (crlf == end)
+    {
+        scanIdx_ = std::max(limit, from + 1) - 1; // the last byte may be a CR whose LF has not arrived yet
+        return std::string::npos;
+    }
+    scanIdx_ = crlf - data + 2;
+    return crlf - data;
+}
+
 HttpData::URLState HttpData::parseRequestLine()
 {
     // Step 1: find the end of the request line
-    size_t pos = inBuffer_.find("\r\n", readIdx_);
+    size_t pos = findLineEnd(MAX_REQUEST_LINE);
     if (pos == std::string::npos)
     {
+        if (inBuffer_.size() - readIdx_ > MAX_REQUEST_LINE)
+        {
+            return URLState::TOOLONG;
+        }
         return URLState::AGAIN; // if the request line is not complete, wait next event to read more data
     }
+    if (pos - readIdx_ > MAX_REQUEST_LINE)
+    {
+        return URLState::TOOLONG;
+    }
 
     // Step 2: extract the request line
     request_line = inBuffer_.substr(readIdx_, pos - readIdx_);
@@ -19,8 +46,13 @@ HttpData::URLState HttpData::parseRequestLine()
         return URLState::ERROR; // not a valid HTTP method
     }
 
-    // Step 4: get the URL
-    size_t url_start = request_line.find(' ') + 1;
+    // Step 4: get the URL, parseHttpMethod has already checked the first space exists
+    size_t method_end = request_line.find(' ');
+    if (method_end == std::string::npos)
+    {
+        return URLState::ERROR;
+    }
+    size_t url_start = method_end + 1;
     size_t url_end = request_line.find(' ', url_start);
     if (url_end == std::string::npos)
     {
@@ -82,9 +114,13 @@ bool HttpData::processUrl(const std::string& url)
         return true;
     }
 
-    // Step 2: trim the URL to remove query parameters
+    // Step 2: trim the URL to remove query parameters, then undo percent-encoding
     size_t query_pos = url.find('?');
-    std::string clean_url = (query_pos != std::string::npos) ? url.substr(0, query_pos) : url;
+    std::string clean_url;
+    if (!decodeUrlPath(std::string_view(url).substr(0, query_pos), clean_url))
+    {
+        return false;
+    }
 
     // Step 3: parse the URL to get the path and filename
     size_t last_slash = clean_url.find_last_of('/');
@@ -121,19 +157,19 @@ bool HttpData::processUrl(const std::string& url)
 
 bool HttpData::isDirectory(const std::string& path)
 {
-    struct stat st;
-    return (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode));
+    FileCache::EntryPtr entry = FileCache::instance().lookup(path);
+    return entry && S_ISDIR(entry->st.st_mode);
 }
 
 bool HttpData::isValidAndSafePath(const std::string& path)
 {
-    char resolvedPath[PATH_MAX];
-    if (realpath(path.c_str(), resolvedPath) == nullptr)
+    // realpath() is resolved once per cache entry, not on every request
+    FileCache::EntryPtr entry = FileCache::instance().lookup(path);
+    if (!entry)
     {
         return false; // Path resolution failed
     }
-    std::string resolvedPathStr(resolvedPath);
-    return resolvedPathStr.find(ROOT_DIR) == 0; // Check if path starts with ROOT_DIR
+    return entry->resolvedPath.find(ROOT_DIR) == 0; // Check if path starts with ROOT_DIR
 }
 
 bool HttpData::parseHttpVersion(const std::string& version)
@@ -159,26 +195,42 @@ HttpData::HeaderState HttpData::parseHeader()
     while (true)
     {
         // Step 1: Check the end position of the current line
-        size_t lineEnd = inBuffer_.find("\r\n", readIdx_);
+        size_t budget = headerBytes_ < MAX_HEADER_BYTES ? MAX_HEADER_BYTES - headerBytes_ : 0;
+        size_t lineEnd = findLineEnd(std::min(MAX_HEADER_LINE, budget));
+        size_t lineLen = (lineEnd == std::string::npos ? inBuffer_.size() : lineEnd) - readIdx_;
+        if (lineLen > MAX_HEADER_LINE || headerBytes_ + lineLen > MAX_HEADER_BYTES)
+        {
+            return HeaderState::TOOLARGE;
+        }
         if (lineEnd == std::string::npos)
         {
             return HeaderState::AGAIN; // Incomplete data, need more data
         }
 
         // Step 2: Check if the line is empty, empty line indicates the end of header parsing
-        if (lineEnd == readIdx_)
+        if (lineEnd == static_cast<size_t>(readIdx_))
         {
             readIdx_ += 2; // Skip \r\n
             break;
         }
-
-        // Step 3: Check the position of the colon to separate the header key and value
-        size_t colonPos = inBuffer_.find(':', readIdx_);
-        if (colonPos == std::string::npos || colonPos > lineEnd)
+        if (++headerCount_ > MAX_HEADER_COUNT)
+        {
+            return HeaderState::TOOLARGE;
+        }
+        headerBytes_ += lineLen + 2;
+
+        // Step 3: Check the position of the colon to separate the header key and value,
+        // only within the current line
+        const char* data = inBuffer_.data();
+        const char* crlf = data + lineEnd;
+        const char* colon = findChar(data + readIdx_, crlf, ':');
+        if (colon == crlf)
         {
             return HeaderState::ERROR; // Invalid header format
         }
 
+        size_t colonPos = colon - data;
+
         // Step 4: Extract header key
         std::string key = inBuffer_.substr(readIdx_, colonPos - readIdx_);
         key = trimTrailingSpaces(key); // Remove trailing spaces from key
@@ -201,7 +253,16 @@ HttpData::HeaderState HttpData::parseHeader()
             return HeaderState::ERROR; // Invalid header value
         }
 
-        // Step 6: Save key-value pair to header table
+        // Step 6: Save key-value pair to header table. Repeated Content-Length fields must
+        // agree, or the body would be framed by whichever one a parser happens to keep
+        if (strcasecmp(key.c_str(), "Content-Length") == 0)
+        {
+            const std::string* previous = findHeader(key);
+            if (previous && *previous != value)
+            {
+                return HeaderState::ERROR;
+            }
+        }
         headerFields_[key] = value;
 
         // Step 7: Update read position, process next line
@@ -210,6 +271,166 @@ HttpData::HeaderState HttpData::parseHeader()
     return HeaderState::SUCCESS;
 }
 
+const std::string* HttpData::findHeader(const std::string& name) const
+{
+    for (const auto& field : headerFields_)
+    {
+        if (strcasecmp(field.first.c_str(), name.c_str()) == 0)
+        {
+            return &field.second;
+        }
+    }
+    return nullptr;
+}
+
+HttpData::BodyState HttpData::startBody()
+{
+    const std::string* transferEncoding = findHeader("Transfer-Encoding");
+    const std::string* contentLength = findHeader("Content-Length");
+    if (transferEncoding)
+    {
+        if (contentLength)
+        {
+            return BodyState::ERROR; // ambiguous framing, a request smuggling vector
+        }
+        if (strcasecmp(transferEncoding->c_str(), "chunked") != 0)
+        {
+            return BodyState::UNSUPPORTED;
+        }
+        bodyFraming_ = BodyFraming::CHUNKED;
+        chunkState_ = ChunkState::SIZE;
+        return BodyState::SUCCESS;
+    }
+
+    // Without either header the body is empty
+    size_t length = 0;
+    if (contentLength)
+    {
+        // Digits only: stoull would also take a sign or leading blanks, and an empty
+        // field is not the same as no field
+        if (contentLength->empty() || !std::all_of(contentLength->begin(), contentLength->end(), [](unsigned char c) { return std::isdigit(c); }))
+        {
+            return BodyState::ERROR;
+        }
+        if (contentLength->size() > 19 || std::stoull(*contentLength) > MAX_BODY_SIZE)
+        {
+            return BodyState::TOOLARGE;
+        }
+        length = std::stoull(*contentLength);
+    }
+    bodyFraming_ = BodyFraming::LENGTH;
+    bodyRemaining_ = length;
+    return BodyState::SUCCESS;
+}
+
+HttpData::BodyState HttpData::parseBody()
+{
+    if (bodyFraming_ == BodyFraming::NONE)
+    {
+        BodyState state = startBody();
+        if (state != BodyState::SUCCESS)
+        {
+            return state;
+        }
+    }
+
+    if (bodyFraming_ == BodyFraming::CHUNKED)
+    {
+        return parseChunkedBody();
+    }
+
+    // Content-Length: wait for the whole body, then take it in one piece
+    if (inBuffer_.size() - readIdx_ < bodyRemaining_)
+    {
+        return BodyState::AGAIN;
+    }
+    body_.assign(inBuffer_, readIdx_, bodyRemaining_);
+    readIdx_ += bodyRemaining_;
+    bodyRemaining_ = 0;
+    return BodyState::SUCCESS;
+}
+
+HttpData::BodyState HttpData::parseChunkedBody()
+{
+    while (true)
+    {
+        if (chunkState_ == ChunkState::SIZE || chunkState_ == ChunkState::TRAILER)
+        {
+            size_t lineEnd = findLineEnd(MAX_HEADER_LINE);
+            size_t lineLen = (lineEnd == std::string::npos ? inBuffer_.size() : lineEnd) - readIdx_;
+            if (lineLen > MAX_HEADER_LINE)
+            {
+                return BodyState::ERROR;
+            }
+            if (lineEnd == std::string::npos)
+            {
+                return BodyState::AGAIN;
+            }
+
+            if (chunkState_ == ChunkState::TRAILER)
+            {
+                // trailer fields are skipped, the blank line ends the body
+                bool last = lineEnd == static_cast<size_t>(readIdx_);
+                readIdx_ = lineEnd + 2;
+                if (last)
+                {
+                    return BodyState::SUCCESS;
+                }
+                continue;
+            }
+
+            // chunk size in hex, optionally followed by ;extensions which are ignored
+            size_t size = 0;
+            size_t pos = readIdx_;
+            for (; pos < lineEnd && isxdigit(static_cast<unsigned char>(inBuffer_[pos])); ++pos)
+            {
+                if (pos - readIdx_ >= 15)
+                {
+                    return BodyState::TOOLARGE;
+                }
+                char c = inBuffer_[pos];
+                size = size * 16 + (isdigit(static_cast<unsigned char>(c)) ? c - '0' : tolower(c) - 'a' + 10);
+            }
+            if (pos == static_cast<size_t>(readIdx_) || (pos < lineEnd && inBuffer_[pos] != ';' && inBuffer_[pos] != ' ' && inBuffer_[pos] != '\t'))
+            {
+                return BodyState::ERROR;
+            }
+            if (body_.size() + size > MAX_BODY_SIZE)
+            {
+                return BodyState::TOOLARGE;
+            }
+            readIdx_ = lineEnd + 2;
+            bodyRemaining_ = size;
+            chunkState_ = size > 0 ? ChunkState::DATA : ChunkState::TRAILER;
+        }
+        else if (chunkState_ == ChunkState::DATA)
+        {
+            size_t len = std::min(inBuffer_.size() - readIdx_, bodyRemaining_);
+            body_.append(inBuffer_, readIdx_, len);
+            readIdx_ += len;
+            bodyRemaining_ -= len;
+            if (bodyRemaining_ > 0)
+            {
+                return BodyState::AGAIN;
+            }
+            chunkState_ = ChunkState::DATA_CRLF;
+        }
+        else
+        {
+            if (inBuffer_.size() - readIdx_ < 2)
+            {
+                return BodyState::AGAIN;
+            }
+            if (inBuffer_.compare(readIdx_, 2, "\r\n") != 0)
+            {
+                return BodyState::ERROR;
+            }
+            readIdx_ += 2;
+            chunkState_ = ChunkState::SIZE;
+        }
+    }
+}
+
 std::string HttpData::trimTrailingSpaces(const std::string& str)
 {
     size_t end = str.find_last_not_of(" \t");
@@ -225,11 +446,9 @@ HttpData::AnalyzeState HttpData::generateSendHTTP()
     // Get file type
     std::string filetype = getFileType(filename_);
 
-    // don't support POST method
     if (httpMethod_ == HttpMethod::POST)
     {
-        sendErrorHttp(fd_, 501, "Not Implemented");
-        return AnalyzeState::ERROR;
+        return handlePostRequest();
     }
 
     // build response header
@@ -284,12 +503,7 @@ void HttpData::sendErrorHttp(int fd, int err_num, std::string msg)
 
 std::string HttpData::getFileType(const std::string& filename)
 {
-    size_t dot_pos = filename_.find('.');
-    if (dot_pos == std::string::npos)
-    {
-        return getMime("default");
-    }
-    return getMime(filename_.substr(dot_pos));
+    return ResponseCache::mimeType(filename);
 }
 
 std::string HttpData::buildResponseHeader(const std::string& filetype)
@@ -314,9 +528,27 @@ std::string HttpData::buildResponseHeader(const std::string& filetype)
     return header;
 }
 
+std::string HttpData::buildEntityHeader(const std::string& filetype, off_t fileSize)
+{
+    // the same headers ResponseCache builds for its entries, plus the range of a 206
+    std::string header;
+    if (filetype == "video/mp4")
+    {
+        header = "Content-Range: bytes 0-" + std::to_string(fileSize - 1) + "/" + std::to_string(fileSize) + "\r\n";
+    }
+    return header + ResponseCache::entityHeaders(filetype, fileSize);
+}
+
 HttpData::AnalyzeState HttpData::handleHelloRequest()
 {
-    outBuffer_ = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 11\r\n\r\nHello World";
+    outputQueue_.append(std::string("HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 11\r\n\r\nHello World"));
+    return AnalyzeState::SUCCESS;
+}
+
+HttpData::AnalyzeState HttpData::handlePostRequest()
+{
+    std::string body = "Received " + std::to_string(body_.size()) + " bytes";
+    outputQueue_.append("HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body);
     return AnalyzeState::SUCCESS;
 }
 
@@ -333,75 +565,64 @@ HttpData::AnalyzeState HttpData::handleIndexRequest(std::string& header)
     header += "Content-Length: " + std::to_string(body.size()) + "\r\n";
     header += "Server: MerceMay's Web Server\r\n\r\n";
 
-    outBuffer_ = header + body;
+    outputQueue_.append(std::move(header));
+    outputQueue_.append(std::move(body));
     return AnalyzeState::SUCCESS;
 }
 
 HttpData::AnalyzeState HttpData::handleFileRequest(std::string& header, const std::string& filetype)
 {
     std::string fullPath = path_ + "/" + filename_;
-    struct stat sbuf;
+    FileCache::EntryPtr entry = FileCache::instance().lookup(fullPath);
 
-    if (stat(fullPath.c_str(), &sbuf) < 0)
+    if (!entry)
     {
         sendErrorHttp(fd_, 404, "Not Found");
         return AnalyzeState::ERROR;
     }
+    const struct stat& sbuf = entry->st;
 
-    header += "Content-Type: " + filetype + "\r\n";
-    if (filetype == "video/mp4")
+    // Small hot files: entity headers and body come prebuilt from ResponseCache,
+    // only the status line and connection headers are per request. The 206 sent for
+    // videos needs a Content-Range the cached headers do not have.
+    if (httpMethod_ == HttpMethod::GET && filetype != "video/mp4" && ResponseCache::instance().cacheable(*entry))
     {
-        header += "Content-Range: bytes 0-" + std::to_string(sbuf.st_size - 1) + "/" + std::to_string(sbuf.st_size) + "\r\n";
+        ResponseCache::ResponsePtr cached = ResponseCache::instance().lookup(*entry);
+        if (!cached)
+        {
+            cached = ResponseCache::instance().insert(*entry);
+        }
+        if (cached)
+        {
+            outputQueue_.append(std::move(header));
+            outputQueue_.append(cached->data); // shared, not copied
+            return AnalyzeState::SUCCESS;
+        }
     }
-    header += "Content-Length: " + std::to_string(sbuf.st_size) + "\r\n";
-    header += "Server: MerceMay's Web Server\r\n\r\n";
+
+    header += buildEntityHeader(filetype, sbuf.st_size);
 
     if (httpMethod_ == HttpMethod::HEAD)
     {
-        outBuffer_ = header;
+        outputQueue_.append(std::move(header));
         return AnalyzeState::SUCCESS;
     }
 
-    return sendFileContent(fullPath, header, sbuf.st_size);
+    return sendFileContent(entry, header);
 }
 
-HttpData::AnalyzeState HttpData::sendFileContent(const std::string& fullPath, const std::string& header, size_t fileSize)
+HttpData::AnalyzeState HttpData::sendFileContent(const FileCache::EntryPtr& entry, const std::string& header)
 {
-    int src_fd = open(fullPath.c_str(), O_RDONLY);
-    if (src_fd < 0)
-    {
-        sendErrorHttp(fd_, 404, "Not Found");
-        return AnalyzeState::ERROR;
-    }
-
-    // use mmap to map the file into memory, which uses RAII to manage the resource
-    struct MmapCloser
-    {
-        void* addr = nullptr;
-        size_t length = 0;
-
-        ~MmapCloser()
-        {
-            if (addr != nullptr && addr != MAP_FAILED)
-            {
-                munmap(addr, length);
-            }
-        }
-    };
-
-    MmapCloser mmapResource;
-    mmapResource.length = fileSize;
-    mmapResource.addr = mmap(nullptr, mmapResource.length, PROT_READ, MAP_PRIVATE, src_fd, 0);
-    close(src_fd);
-
-    if (mmapResource.addr == MAP_FAILED)
+    if (!entry->file)
     {
-        sendErrorHttp(fd_, 404, "Not Found");
+        sendErrorHttp(fd_, 404, "Not Found"); // not a regular file
         return AnalyzeState::ERROR;
     }
 
-    char* src_addr = static_cast<char*>(mmapResource.addr);
-    outBuffer_ = header + std::string(src_addr, fileSize);
+    // the file is not read into memory: handleWrite() sends the header, then streams
+    // the cached fd with sendfile, resuming where partial writes stopped
+    outputQueue_.append(header.data(), header.size());
+    outputQueue_.appendFile(entry->file, 0, entry->st.st_size);
 
     return AnalyzeState::SUCCESS;
 }
@@ -441,7 +662,7 @@ bool HttpData::curPathFileList(std::string path, std::string& body)
             }
 
             // Add to HTML link
-            body += "<li><a href=\"" + fullPath + "\">" + name + "</a></li>";
+            body += "<li><a href=\"" + escapeHtml(encodeUrlPath(fullPath)) + "\">" + escapeHtml(name) + "</a></li>";
         }
         closedir(dir);
     }
@@ -456,27 +677,13 @@ bool HttpData::curPathFileList(std::string path, std::string& body)
 void HttpData::handleConnect()
 {
     unlinkTimer(); // Start handling the connection, so the timer can be canceled
-    unsigned int event = channel_->getEvents();
     if (!error_ && connectionState_ == ConnectionState::CONNECTED) // Connection has been established
     {
-        int timeout = isKeepAlive_ ? DEFAULT_KEEP_ALIVE_TIME : DEFAULT_EXPIRED_TIME;
-        if (event != 0) // Connection has been established and events have occurred
-        {
-            if ((event & EPOLLIN) && (event & EPOLLOUT)) // Both read and write events, prioritize write events
-            {
-                event = EPOLLOUT;
-            }
-            event |= EPOLLET; // Edge-triggered, ensure performance
-        }
-        else
-        {
-            event |= (EPOLLIN | EPOLLET); // Connection has been established and no events occurred, set to read event
-        }
-        updateEventAndTimeout(channel_, event, timeout); // update events and timeout
+        resetTimer(isKeepAlive_ ? DEFAULT_KEEP_ALIVE_TIME : DEFAULT_EXPIRED_TIME);
     }
-    else if (!error_ && connectionState_ == ConnectionState::DISCONNECTING && (event & EPOLLOUT)) // indicate that the connection is closing, but there are data to be sent
+    else if (!error_ && connectionState_ == ConnectionState::DISCONNECTING && channel_->isWriting()) // indicate that the connection is closing, but there are data to be sent
     {
-        updateEvent(channel_, EPOLLOUT | EPOLLET); // set channel_ only handle write event
+        channel_->disableReading(); // set channel_ only handle write event
     }
     else // indicate that the connection should be closed
     {
@@ -490,7 +697,6 @@ void HttpData::handleRead()
     // anonymous lambda function, which avoids to use goto 
     [&]()
     {
-        bool zero = false;
         int readBytes = readn(fd_, inBuffer_);
 
         // Connection is closing, directly clear the buffer
@@ -547,6 +753,14 @@ void HttpData::handleRead()
                 sendErrorHttp(fd_, 403, "Forbidden");
                 return;
             }
+            else if (urlState == URLState::TOOLONG)
+            {
+                error_ = true;
+                LOG("log") << "Request line too long";
+                inBuffer_.clear();
+                sendErrorHttp(fd_, 414, "URI Too Long");
+                return;
+            }
             else if (urlState == URLState::ERROR)
             {
                 error_ = true;
@@ -570,6 +784,14 @@ void HttpData::handleRead()
             {
                 return;
             }
+            else if (headerState == HeaderState::TOOLARGE)
+            {
+                error_ = true;
+                LOG("log") << "Request headers too large";
+                sendErrorHttp(fd_, 431, "Request Header Fields Too Large");
+                inBuffer_.clear();
+                return;
+            }
             else if (headerState == HeaderState::ERROR)
             {
                 error_ = true;
@@ -594,45 +816,35 @@ void HttpData::handleRead()
         // POST request, read the body
         if (processState_ == ProcessState::RECV_BODY)
         {
-            int content_length = -1;
-            if (headerFields_.find("Content-length") != headerFields_.end())
+            BodyState bodyState = parseBody();
+            if (bodyState == BodyState::AGAIN)
             {
-                const std::string& contentLengthStr = headerFields_["Content-length"];
-                // Validate that Content-length is a pure number
-                if (!contentLengthStr.empty() && std::all_of(contentLengthStr.begin(), contentLengthStr.end(), ::isdigit))
-                {
-                    try
-                    {
-                        content_length = stoi(contentLengthStr);
-                    }
-                    catch (const std::exception& e)
-                    {
-                        error_ = true;
-                        sendErrorHttp(fd_, 400, "Bad Request: Invalid Content-length");
-                        LOG("log") << "Invalid Content-length: " << contentLengthStr;
-                        inBuffer_.clear();
-                        return;
-                    }
-                }
-                else
-                {
-                    error_ = true;
-                    sendErrorHttp(fd_, 400, "Bad Request: Invalid Content-length");
-                    LOG("log") << "Invalid Content-length: " << contentLengthStr;
-                    inBuffer_.clear();
-                    return;
-                }
+                return;
             }
-            else
+            else if (bodyState == BodyState::TOOLARGE)
+            {
+                error_ = true;
+                LOG("log") << "Request body too large";
+                sendErrorHttp(fd_, 413, "Content Too Large");
+                inBuffer_.clear();
+                return;
+            }
+            else if (bodyState == BodyState::UNSUPPORTED)
             {
                 error_ = true;
-                sendErrorHttp(fd_, 400, "Bad Request: Lack of argument (Content-length)");
-                LOG("log") << "Lack of argument (Content-length)";
+                LOG("log") << "Unsupported transfer coding";
+                sendErrorHttp(fd_, 501, "Not Implemented");
                 inBuffer_.clear();
                 return;
             }
-            if (static_cast<int>(inBuffer_.size()) < content_length) // indicate that the body is not complete
+            else if (bodyState == BodyState::ERROR)
+            {
+                error_ = true;
+                LOG("log") << "Error in request body";
+                sendErrorHttp(fd_, 400, "Bad Request: error in body");
+                inBuffer_.clear();
                 return;
+            }
             processState_ = ProcessState::ANALYZE;
         }
 
@@ -658,12 +870,11 @@ void HttpData::handleRead()
         return;
     }
 
-    unsigned int events = channel_->getEvents();
-
-    // there is data to be sent
-    if (!outBuffer_.empty())
+    // there is data to be sent, add write event; read events stay enabled for the
+    // next request or the rest of this one
+    if (!outputQueue_.empty() && !channel_->isWriting())
     {
-        events |= EPOLLOUT | EPOLLET; // add write event
+        channel_->enableWriting();
     }
 
     if (processState_ == ProcessState::FINISH) // request has been processed
@@ -673,32 +884,18 @@ void HttpData::handleRead()
         if (connectionState_ == ConnectionState::DISCONNECTING)
         {
             loop_->runInLoop(std::bind(&HttpData::handleClose, shared_from_this()));
-            return;
-        }
-
-        // there is still unprocessed data in the buffer, indicating a keep-alive connection, register read event again
-        if (!inBuffer_.empty())
-        {
-            events |= EPOLLIN | EPOLLET; // add read event
         }
     }
-    else if (connectionState_ != ConnectionState::DISCONNECTED) // connection is not disconnected and reaching here indicates previous requests are not processed
-    {
-        events |= EPOLLIN | EPOLLET; // add read event, indicating there are unfinished requests
-    }
-    // update events
-    updateEvent(channel_, events);
 }
 
 void HttpData::handleWrite()
 {
     if (!error_ && connectionState_ != ConnectionState::DISCONNECTED)
     {
-        unsigned int events = channel_->getEvents();
-
-        // write data to file descriptor
-        int writeResult = writen(fd_, outBuffer_);
-        if (writeResult < 0)
+        // write data to file descriptor, segments in order until the socket is full
+        int savedErrno = 0;
+        ssize_t writeResult = outputQueue_.writeFd(fd_, &savedErrno);
+        if (writeResult < 0 && savedErrno != EAGAIN && savedErrno != EWOULDBLOCK)
         {
             // write failed, handle error
             std::cerr << "Error State: error in write" << std::endl;
@@ -707,46 +904,35 @@ void HttpData::handleWrite()
             return;
         }
 
-        if (outBuffer_.empty())
+        if (outputQueue_.empty())
         {
             // write operation completed, buffer is empty
             if (connectionState_ == ConnectionState::DISCONNECTING)
             {
                 loop_->runInLoop(std::bind(&HttpData::handleClose, shared_from_this())); // close connection
             }
-            else
+            else if (channel_->isWriting())
             {
-                // write operation completed, buffer is empty
-                events |= EPOLLIN | EPOLLET;
-                events &= ~EPOLLOUT; // remove write event
+                channel_->disableWriting(); // remove write event
             }
         }
-        else
-        {
-            // write buffer still has data, continue to listen for write events
-            events |= EPOLLOUT | EPOLLET;
-        }
-
-        // update events
-        updateEvent(channel_, events);
+        // otherwise the write buffer still has data, continue to listen for write events
     }
 }
 
-void HttpData::updateEventAndTimeout(std::shared_ptr<Channel> channel, unsigned int newEvent, int timeout)
-{
-    unsigned int& event = channel->getEvents();
-    event = newEvent;                    // modify events
-    loop_->modChannel(channel, timeout); // update event listening status
-}
-
-void HttpData::updateEvent(std::shared_ptr<Channel> channel, unsigned int newEvent)
+void HttpData::resetTimer(int timeout)
 {
-    unsigned int& event = channel->getEvents();
-    event = newEvent;           // modify events
-    loop_->modChannel(channel); // update event listening status
+    unlinkTimer();
+    std::weak_ptr<HttpData> weak(shared_from_this());
+    timer_ = loop_->runAfter(timeout / 1000.0, [weak]() {
+        if (std::shared_ptr<HttpData> data = weak.lock())
+        {
+            data->handleClose();
+        }
+    });
 }
 
-HttpData::HttpData(std::shared_ptr<EventLoop> loop, int fd)
+HttpData::HttpData(EventLoop* loop, int fd)
     : loop_(loop),
       fd_(fd),
       error_(false),
@@ -754,56 +940,65 @@ HttpData::HttpData(std::shared_ptr<EventLoop> loop, int fd)
       httpMethod_(HttpMethod::GET),
       httpVersion_(HttpVersion::HTTP_11),
       readIdx_(0),
+      scanIdx_(0),
+      headerCount_(0),
+      headerBytes_(0),
       processState_(ProcessState::PARSE_URL),
       parseState_(ParseState::START),
-      isKeepAlive_(false)
+      isKeepAlive_(false),
+      bodyFraming_(BodyFraming::NONE),
+      chunkState_(ChunkState::SIZE),
+      bodyRemaining_(0)
 {
+    // handleConnect() follows every event: it re-arms the timeout or closes the connection
     channel_ = std::make_shared<Channel>(loop, fd);
-    channel_->setConnectHandler(std::bind(&HttpData::handleConnect, this));
-    channel_->setReadHandler(std::bind(&HttpData::handleRead, this));
-    channel_->setWriteHandler(std::bind(&HttpData::handleWrite, this));
+    channel_->setReadCallback([this]() {
+        handleRead();
+        handleConnect();
+    });
+    channel_->setWriteCallback([this]() {
+        handleWrite();
+        handleConnect();
+    });
 }
 
 HttpData::~HttpData()
 {
     unlinkTimer();
-    if (channel_)
-    {
-        channel_->setHolder(nullptr);
-        channel_->setFd(-1);
-        channel_.reset();
-    }
+    channel_.reset(); // removed from the loop by handleClose()
     close(fd_);
 }
 
 void HttpData::reset()
 {
     readIdx_ = 0;
+    scanIdx_ = 0;
+    headerCount_ = 0;
+    headerBytes_ = 0;
     processState_ = ProcessState::PARSE_URL;
     parseState_ = ParseState::START;
 
     filename_.clear();
     path_.clear();
     headerFields_.clear();
+    bodyFraming_ = BodyFraming::NONE;
+    chunkState_ = ChunkState::SIZE;
+    bodyRemaining_ = 0;
+    body_.clear();
 
     unlinkTimer();
 }
 
-void HttpData::linkTimer(std::shared_ptr<TimerNode> mtimer)
-{
-    timer_ = mtimer;
-}
-
 void HttpData::unlinkTimer()
 {
-    if (auto t = timer_.lock())
+    if (timer_.valid())
     {
-        t->clearHttpData();
-        timer_.reset();
+        loop_->cancel(timer_);
+        timer_ = TimerId();
     }
 }
 
-std::shared_ptr<EventLoop> HttpData::getLoop()
+EventLoop* HttpData::getLoop()
 {
     return loop_;
 }
@@ -815,14 +1010,21 @@ std::shared_ptr<Channel> HttpData::getChannel()
 
 void HttpData::handleClose()
 {
+    if (!self_)
+    {
+        return; // already closed, e.g. by the timer while a close was queued
+    }
     connectionState_ = ConnectionState::DISCONNECTED;
     unlinkTimer();
-    std::shared_ptr<HttpData> guard(shared_from_this()); // move shared_ptr of this object to the guard
-    loop_->removeChannel(channel_);                      // remove channel from EventLoop
+    std::shared_ptr<HttpData> guard(std::move(self_)); // released once the channel is gone
+    channel_->disableAll();
+    channel_->remove(); // remove channel from EventLoop
 }
 
 void HttpData::newEvent()
 {
-    channel_->setEvents(EPOLLIN | EPOLLET | EPOLLONESHOT);
-    loop_->addChannel(channel_, DEFAULT_EXPIRED_TIME);
+    self_ = shared_from_this();
+    channel_->tie(self_);
+    channel_->enableReading();
+    resetTimer(DEFAULT_EXPIRED_TIME);
 }
\ No newline at end of file
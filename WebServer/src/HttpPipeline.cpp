@@ -0,0 +1,77 @@
+#include "HttpPipeline.h"
+#include "TcpConnection.h"
+#include <cassert>
+
+HttpPipeline::HttpPipeline(const std::shared_ptr<TcpConnection>& conn)
+    : conn_(conn),
+      nextSeq_(0),
+      nextToSend_(0),
+      closing_(false)
+{
+}
+
+uint64_t HttpPipeline::reserve()
+{
+    slots_.emplace_back();
+    return nextSeq_++;
+}
+
+void HttpPipeline::complete(uint64_t seq, Response&& response)
+{
+    std::shared_ptr<TcpConnection> conn = conn_.lock();
+    if (!conn)
+    {
+        return;
+    }
+    EventLoop* loop = conn->getLoop();
+    if (loop->isInLoopThread())
+    {
+        completeInLoop(seq, std::move(response));
+    }
+    else
+    {
+        auto self = shared_from_this();
+        auto pending = std::make_shared<Response>(std::move(response));
+        loop->queueInLoop([self, seq, pending]() { self->completeInLoop(seq, std::move(*pending)); });
+    }
+}
+
+void HttpPipeline::completeInLoop(uint64_t seq, Response&& response)
+{
+    assert(seq >= nextToSend_ && seq < nextSeq_);
+    slots_[seq - nextToSend_] = std::move(response);
+
+    std::shared_ptr<TcpConnection> conn = conn_.lock();
+    // Flush the completed prefix; a gap means an earlier handler is still running
+    while (!slots_.empty() && slots_.front())
+    {
+        if (conn && !closing_)
+        {
+            send(conn, *slots_.front());
+        }
+        slots_.pop_front();
+        ++nextToSend_;
+    }
+}
+
+void HttpPipeline::send(const std::shared_ptr<TcpConnection>& conn, Response& response)
+{
+    if (response.file)
+    {
+        conn->sendFile(std::move(response.header), response.file, response.offset, response.len);
+    }
+    else if (response.body)
+    {
+        conn->send(std::move(response.header), response.body);
+    }
+    else
+    {
+        conn->send(std::move(response.header));
+    }
+
+    if (response.close)
+    {
+        closing_ = true;
+        conn->shutdown();
+    }
+}
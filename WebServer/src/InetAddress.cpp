@@ -0,0 +1,79 @@
+#include "InetAddress.h"
+#include <arpa/inet.h>
+#include <cstring>
+
+InetAddress::InetAddress()
+{
+    std::memset(&addr6_, 0, sizeof addr6_);
+    addr_.sin_family = AF_INET;
+}
+
+InetAddress::InetAddress(const struct sockaddr* addr)
+{
+    std::memset(&addr6_, 0, sizeof addr6_);
+    if (addr->sa_family == AF_INET6)
+    {
+        std::memcpy(&addr6_, addr, sizeof addr6_);
+    }
+    else
+    {
+        std::memcpy(&addr_, addr, sizeof addr_);
+    }
+}
+
+uint16_t InetAddress::port() const
+{
+    return ntohs(isIpv6() ? addr6_.sin6_port : addr_.sin_port);
+}
+
+std::string InetAddress::toIp() const
+{
+    char buf[INET6_ADDRSTRLEN] = "";
+    if (isIpv6())
+    {
+        inet_ntop(AF_INET6, &addr6_.sin6_addr, buf, sizeof buf);
+    }
+    else
+    {
+        inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof buf);
+    }
+    return buf;
+}
+
+std::string InetAddress::toIpPort() const
+{
+    if (isIpv6())
+    {
+        return "[" + toIp() + "]:" + std::to_string(port());
+    }
+    return toIp() + ":" + std::to_string(port());
+}
+
+size_t InetAddress::ipHash() const
+{
+    if (isIpv6())
+    {
+        uint64_t halves[2];
+        std::memcpy(halves, &addr6_.sin6_addr, sizeof halves);
+        return std::hash<uint64_t>()(halves[0] ^ (halves[1] * 0x9e3779b97f4a7c15ULL));
+    }
+    return std::hash<uint32_t>()(addr_.sin_addr.s_addr);
+}
+
+size_t InetAddress::hash() const
+{
+    return ipHash() ^ (static_cast<size_t>(port()) * 0x9e3779b97f4a7c15ULL);
+}
+
+bool InetAddress::sameIp(const InetAddress& other) const
+{
+    if (family() != other.family())
+    {
+        return false;
+    }
+    if (isIpv6())
+    {
+        return std::memcmp(&addr6_.sin6_addr, &other.addr6_.sin6_addr, sizeof addr6_.sin6_addr) == 0;
+    }
+    return addr_.sin_addr.s_addr == other.addr_.sin_addr.s_addr;
+}
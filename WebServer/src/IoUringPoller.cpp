@@ -0,0 +1,355 @@
+#include "IoUringPoller.h"
+#include "Channel.h"
+#include "Logging.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cassert>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+const int kNew = -1;
+const int kAdded = 1;
+
+// user_data of SQEs whose completion carries no channel event (poll removals)
+const uint64_t kInternalUserData = 0;
+
+namespace
+{
+int sysIoUringSetup(unsigned entries, struct io_uring_params* params)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int sysIoUringEnter(int ringFd, unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argSize)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, arg, argSize));
+}
+
+uint64_t encodeUserData(int fd, uint32_t generation)
+{
+    return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+}
+
+template <typename T>
+T* ringField(void* ring, uint32_t offset)
+{
+    return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+} // namespace
+
+IoUringPoller::IoUringPoller()
+    : ringFd_(-1),
+      sqRing_(MAP_FAILED),
+      sqRingSize_(0),
+      sqHead_(nullptr),
+      sqTail_(nullptr),
+      sqMask_(0),
+      sqEntries_(0),
+      sqes_(static_cast<struct io_uring_sqe*>(MAP_FAILED)),
+      sqesSize_(0),
+      sqeTail_(0),
+      cqRing_(MAP_FAILED),
+      cqRingSize_(0),
+      cqHead_(nullptr),
+      cqTail_(nullptr),
+      cqMask_(0),
+      cqes_(nullptr),
+      generation_(0)
+{
+    if (!setupRing(kRingEntries))
+    {
+        LOG("log") << "io_uring_setup: " << strerror(errno);
+        closeRing();
+    }
+}
+
+IoUringPoller::~IoUringPoller()
+{
+    closeRing();
+}
+
+bool IoUringPoller::setupRing(unsigned entries)
+{
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof params);
+    ringFd_ = sysIoUringSetup(entries, &params);
+    if (ringFd_ < 0)
+    {
+        return false;
+    }
+    // poll() relies on waiting with a timeout without a separate timeout SQE, and
+    // on the kernel keeping completions that overflow the CQ instead of dropping them
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP))
+    {
+        errno = ENOSYS;
+        return false;
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap)
+    {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED)
+    {
+        return false;
+    }
+    if (singleMmap)
+    {
+        cqRing_ = sqRing_;
+    }
+    else
+    {
+        cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED)
+        {
+            return false;
+        }
+    }
+
+    sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = static_cast<struct io_uring_sqe*>(mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED)
+    {
+        return false;
+    }
+
+    sqHead_ = ringField<unsigned>(sqRing_, params.sq_off.head);
+    sqTail_ = ringField<unsigned>(sqRing_, params.sq_off.tail);
+    sqMask_ = *ringField<unsigned>(sqRing_, params.sq_off.ring_mask);
+    sqEntries_ = *ringField<unsigned>(sqRing_, params.sq_off.ring_entries);
+    sqeTail_ = *sqTail_;
+
+    // SQE slots are always used in ring order, so the index array is the identity
+    unsigned* sqArray = ringField<unsigned>(sqRing_, params.sq_off.array);
+    for (unsigned i = 0; i < sqEntries_; ++i)
+    {
+        sqArray[i] = i;
+    }
+
+    cqHead_ = ringField<unsigned>(cqRing_, params.cq_off.head);
+    cqTail_ = ringField<unsigned>(cqRing_, params.cq_off.tail);
+    cqMask_ = *ringField<unsigned>(cqRing_, params.cq_off.ring_mask);
+    cqes_ = ringField<struct io_uring_cqe>(cqRing_, params.cq_off.cqes);
+    return true;
+}
+
+void IoUringPoller::closeRing()
+{
+    if (sqes_ != MAP_FAILED)
+    {
+        munmap(sqes_, sqesSize_);
+        sqes_ = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+    }
+    if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_)
+    {
+        munmap(cqRing_, cqRingSize_);
+    }
+    cqRing_ = MAP_FAILED;
+    if (sqRing_ != MAP_FAILED)
+    {
+        munmap(sqRing_, sqRingSize_);
+        sqRing_ = MAP_FAILED;
+    }
+    if (ringFd_ >= 0)
+    {
+        close(ringFd_);
+        ringFd_ = -1;
+    }
+}
+
+struct io_uring_sqe* IoUringPoller::getSqe()
+{
+    // SQ full: hand the queued entries to the kernel without waiting. The next slot
+    // still holds an unsubmitted entry until the kernel moves the head past it.
+    while (sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_)
+    {
+        int ret = enter(0, 0);
+        if (ret < 0 && errno != EBUSY && errno != EAGAIN && errno != EINTR)
+        {
+            LOG("log") << "io_uring_enter: " << strerror(errno);
+            abort();
+        }
+        if (ret <= 0)
+        {
+            // the CQ is full and the kernel refuses new work until there is room
+            reapCompletions();
+        }
+    }
+    struct io_uring_sqe* sqe = &sqes_[sqeTail_ & sqMask_];
+    ++sqeTail_;
+    std::memset(sqe, 0, sizeof *sqe);
+    return sqe;
+}
+
+int IoUringPoller::enter(unsigned minComplete, int timeoutMs)
+{
+    __atomic_store_n(sqTail_, sqeTail_, __ATOMIC_RELEASE);
+    unsigned toSubmit = sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+
+    unsigned flags = 0;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    std::memset(&arg, 0, sizeof arg);
+    if (minComplete > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        if (timeoutMs >= 0)
+        {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+        return sysIoUringEnter(ringFd_, toSubmit, minComplete, flags, &arg, sizeof arg);
+    }
+    return sysIoUringEnter(ringFd_, toSubmit, 0, flags, nullptr, 0);
+}
+
+void IoUringPoller::reapCompletions()
+{
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+    {
+        const struct io_uring_cqe& cqe = cqes_[head & cqMask_];
+        if (cqe.user_data != kInternalUserData)
+        {
+            completions_.push_back(Completion{cqe.user_data, cqe.res});
+        }
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+}
+
+uint32_t IoUringPoller::nextGeneration()
+{
+    // generation 0 is reserved so that kInternalUserData never matches a registration
+    if (++generation_ == 0)
+    {
+        ++generation_;
+    }
+    return generation_;
+}
+
+void IoUringPoller::armPoll(int fd, Registration& reg)
+{
+    assert(!reg.armed);
+    struct io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = static_cast<uint32_t>(reg.channel->events()); // EPOLL* and POLL* bits coincide
+    sqe->user_data = encodeUserData(fd, reg.generation);
+    reg.armedEvents = sqe->poll32_events;
+    reg.armed = true;
+}
+
+void IoUringPoller::cancelPoll(Registration& reg)
+{
+    assert(reg.armed);
+    struct io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = encodeUserData(reg.channel->fd(), reg.generation);
+    sqe->user_data = kInternalUserData;
+    // A completion of the cancelled request (-ECANCELED, or a readiness that raced the
+    // removal) carries the old generation and is dropped in poll(). Dropping a readiness
+    // is harmless because a re-armed poll reports the current state of the fd again.
+    reg.generation = nextGeneration();
+    reg.armed = false;
+}
+
+void IoUringPoller::updateChannel(Channel* channel)
+{
+    int fd = channel->fd();
+    auto it = channels_.find(fd);
+    if (it == channels_.end())
+    {
+        it = channels_.emplace(fd, Registration{channel, nextGeneration(), 0, false}).first;
+        channel->setIndex(kAdded);
+    }
+
+    Registration& reg = it->second;
+    uint32_t events = static_cast<uint32_t>(channel->events());
+    if (reg.armed && reg.armedEvents == events)
+    {
+        return;
+    }
+    if (reg.armed)
+    {
+        cancelPoll(reg);
+    }
+    reg.channel = channel;
+    if (events != 0)
+    {
+        armPoll(fd, reg);
+    }
+}
+
+void IoUringPoller::removeChannel(Channel* channel)
+{
+    auto it = channels_.find(channel->fd());
+    if (it != channels_.end() && it->second.channel == channel)
+    {
+        if (it->second.armed)
+        {
+            cancelPoll(it->second);
+        }
+        channels_.erase(it);
+    }
+    channel->setIndex(kNew);
+}
+
+bool IoUringPoller::hasChannel(Channel* channel) const
+{
+    auto it = channels_.find(channel->fd());
+    return it != channels_.end() && it->second.channel == channel;
+}
+
+void IoUringPoller::poll(int timeoutMs, ChannelList* activeChannels)
+{
+    // One-shot polls that fired last round are re-armed here, after the handlers had
+    // their chance to change the interest set, so level-triggered semantics hold.
+    for (int fd : rearmFds_)
+    {
+        auto it = channels_.find(fd);
+        if (it != channels_.end() && !it->second.armed && it->second.channel->events() != 0)
+        {
+            armPoll(fd, it->second);
+        }
+    }
+    rearmFds_.clear();
+
+    // don't block if getSqe() already had to take completions off the CQ
+    int ret = enter(1, completions_.empty() ? timeoutMs : 0);
+    if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+    {
+        LOG("log") << "io_uring_enter: " << strerror(errno);
+    }
+    // EBUSY means the CQ overflowed: reaping it makes room for the kernel to flush
+    // the backlog, and the unsubmitted SQEs go in with the next enter()
+    reapCompletions();
+
+    for (const Completion& completion : completions_)
+    {
+        int fd = static_cast<int>(static_cast<uint32_t>(completion.userData));
+        uint32_t generation = static_cast<uint32_t>(completion.userData >> 32);
+
+        auto it = channels_.find(fd);
+        if (it == channels_.end() || it->second.generation != generation)
+        {
+            continue; // stale completion of a cancelled or replaced poll
+        }
+        Registration& reg = it->second;
+        reg.armed = false;
+        reg.channel->setRevents(completion.res >= 0 ? completion.res : static_cast<int>(EPOLLERR));
+        activeChannels->push_back(reg.channel);
+        rearmFds_.push_back(fd);
+    }
+    completions_.clear();
+}
@@ -0,0 +1,141 @@
+#include "OutputQueue.h"
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <errno.h>
+
+void OutputQueue::append(const char* data, size_t len)
+{
+    if (len == 0)
+    {
+        return;
+    }
+    if (!segments_.empty())
+    {
+        Segment& last = segments_.back();
+        if (!last.blob && !last.file && last.owned.size() + len <= kCoalesceLimit)
+        {
+            last.owned.append(data, len);
+            last.len += len;
+            readableBytes_ += len;
+            return;
+        }
+    }
+    segments_.push_back(Segment{std::string(data, len), nullptr, nullptr, 0, len});
+    readableBytes_ += len;
+}
+
+void OutputQueue::append(std::string&& data, size_t offset)
+{
+    if (offset >= data.size())
+    {
+        return;
+    }
+    size_t len = data.size() - offset;
+    segments_.push_back(Segment{std::move(data), nullptr, nullptr, offset, len});
+    readableBytes_ += len;
+}
+
+void OutputQueue::append(const Blob& blob, size_t offset)
+{
+    if (!blob || offset >= blob->size())
+    {
+        return;
+    }
+    size_t len = blob->size() - offset;
+    segments_.push_back(Segment{std::string(), blob, nullptr, offset, len});
+    readableBytes_ += len;
+}
+
+void OutputQueue::appendFile(const File& file, off_t offset, size_t len)
+{
+    if (!file || len == 0)
+    {
+        return;
+    }
+    segments_.push_back(Segment{std::string(), nullptr, file, static_cast<size_t>(offset), len});
+    readableBytes_ += len;
+}
+
+ssize_t OutputQueue::writeFd(int fd, int* savedErrno)
+{
+    ssize_t total = 0;
+    while (!segments_.empty())
+    {
+        size_t attempted = 0;
+        ssize_t n = segments_.front().file ? writeFile(fd, &attempted) : writeMemory(fd, &attempted);
+        if (n < 0)
+        {
+            if (total > 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                break; // report the progress made before the socket filled up
+            }
+            *savedErrno = errno;
+            return -1;
+        }
+        total += n;
+        if (static_cast<size_t>(n) < attempted)
+        {
+            break; // socket buffer is full
+        }
+    }
+    return total;
+}
+
+ssize_t OutputQueue::writeMemory(int fd, size_t* attempted)
+{
+    // gather the memory segments in front of the next file segment
+    struct iovec vec[kMaxIovecs];
+    int iovcnt = 0;
+    for (auto it = segments_.begin(); it != segments_.end() && !it->file && iovcnt < kMaxIovecs; ++it)
+    {
+        vec[iovcnt].iov_base = const_cast<char*>(it->data());
+        vec[iovcnt].iov_len = it->len;
+        *attempted += it->len;
+        ++iovcnt;
+    }
+
+    const ssize_t n = writev(fd, vec, iovcnt);
+    if (n > 0)
+    {
+        retrieve(static_cast<size_t>(n));
+    }
+    return n;
+}
+
+ssize_t OutputQueue::writeFile(int fd, size_t* attempted)
+{
+    Segment& front = segments_.front();
+    off_t offset = static_cast<off_t>(front.offset);
+    *attempted = front.len;
+
+    const ssize_t n = sendfile(fd, front.file->fd(), &offset, front.len);
+    if (n > 0)
+    {
+        retrieve(static_cast<size_t>(n));
+    }
+    else if (n == 0)
+    {
+        // the file shrank under us: the response can no longer match the length its headers
+        // announced, so the connection has to be closed rather than continued short
+        errno = EIO;
+        return -1;
+    }
+    return n;
+}
+
+void OutputQueue::retrieve(size_t len)
+{
+    readableBytes_ -= len;
+    while (len > 0)
+    {
+        Segment& front = segments_.front();
+        if (len < front.len)
+        {
+            front.offset += len;
+            front.len -= len;
+            return;
+        }
+        len -= front.len;
+        segments_.pop_front();
+    }
+}
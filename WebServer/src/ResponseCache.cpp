@@ -0,0 +1,138 @@
+#include "ResponseCache.h"
+#include <unistd.h>
+
+namespace
+{
+const std::unordered_map<std::string, std::string> kMimeTypes = {
+    {".html", "text/html"},
+    {".avi", "video/x-msvideo"},
+    {".mp4", "video/mp4"},
+    {".bmp", "image/bmp"},
+    {".c", "text/plain"},
+    {".cpp", "text/plain"},
+    {".doc", "application/msword"},
+    {".gif", "image/gif"},
+    {".gz", "application/x-gzip"},
+    {".htm", "text/html"},
+    {".ico", "image/x-icon"},
+    {".jpg", "image/jpeg"},
+    {".png", "image/png"},
+    {".txt", "text/plain"},
+    {".mp3", "audio/mp3"}};
+} // namespace
+
+ResponseCache::ResponseCache(size_t maxBytes, size_t maxObjectSize)
+    : maxBytes_(maxBytes),
+      maxObjectSize_(maxObjectSize),
+      totalBytes_(0)
+{
+}
+
+ResponseCache& ResponseCache::instance()
+{
+    static ResponseCache cache;
+    return cache;
+}
+
+std::string ResponseCache::mimeType(const std::string& filename)
+{
+    size_t dot = filename.find_last_of("./");
+    if (dot != std::string::npos && filename[dot] == '.')
+    {
+        auto it = kMimeTypes.find(filename.substr(dot));
+        if (it != kMimeTypes.end())
+        {
+            return it->second;
+        }
+    }
+    return "text/html";
+}
+
+std::string ResponseCache::entityHeaders(const std::string& contentType, off_t size)
+{
+    std::string header = "Content-Type: " + contentType + "\r\n";
+    header += "Content-Length: " + std::to_string(size) + "\r\n";
+    header += "Server: MerceMay's Web Server\r\n\r\n";
+    return header;
+}
+
+ResponseCache::ResponsePtr ResponseCache::lookup(const FileCache::Entry& file)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = responses_.find(file.resolvedPath);
+    if (it == responses_.end())
+    {
+        return nullptr;
+    }
+
+    const Response& cached = *it->second.response;
+    if (cached.ino != file.st.st_ino || cached.size != file.st.st_size ||
+        cached.mtime.tv_sec != file.st.st_mtim.tv_sec || cached.mtime.tv_nsec != file.st.st_mtim.tv_nsec)
+    {
+        eraseLocked(it); // the file changed since it was cached
+        return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second.lruPos);
+    return it->second.response;
+}
+
+ResponseCache::ResponsePtr ResponseCache::insert(const FileCache::Entry& file)
+{
+    if (!cacheable(file))
+    {
+        return nullptr;
+    }
+    const std::string entityHeaders = ResponseCache::entityHeaders(mimeType(file.resolvedPath), file.st.st_size);
+
+    // build the blob outside the lock
+    size_t size = static_cast<size_t>(file.st.st_size);
+    std::string data;
+    data.reserve(entityHeaders.size() + size);
+    data = entityHeaders;
+    data.resize(entityHeaders.size() + size);
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t n = pread(file.file->fd(), &data[entityHeaders.size() + done], size - done, static_cast<off_t>(done));
+        if (n <= 0)
+        {
+            return nullptr; // read error or the file shrank
+        }
+        done += n;
+    }
+
+    auto response = std::make_shared<Response>();
+    response->data = std::make_shared<const std::string>(std::move(data));
+    response->ino = file.st.st_ino;
+    response->size = file.st.st_size;
+    response->mtime = file.st.st_mtim;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = responses_.find(file.resolvedPath);
+    if (it != responses_.end())
+    {
+        eraseLocked(it);
+    }
+    lru_.push_front(file.resolvedPath);
+    responses_[file.resolvedPath] = Slot{response, lru_.begin()};
+    totalBytes_ += response->data->size();
+    while (totalBytes_ > maxBytes_ && !lru_.empty())
+    {
+        eraseLocked(responses_.find(lru_.back()));
+    }
+    return response;
+}
+
+size_t ResponseCache::totalBytes()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return totalBytes_;
+}
+
+void ResponseCache::eraseLocked(std::unordered_map<std::string, Slot>::iterator it)
+{
+    // holders of the ResponsePtr keep the blob alive until their write finishes
+    totalBytes_ -= it->second.response->data->size();
+    lru_.erase(it->second.lruPos);
+    responses_.erase(it);
+}
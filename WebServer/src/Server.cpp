@@ -1,27 +1,88 @@
 #include "Server.h"
 #include "Util.h"
 #include <iostream>
+#include <chrono>
 #include <functional>
+#include <future>
 
-Server::Server(EventLoop* loop, int threadNum, int port)
+namespace
+{
+// Runs cb in loop's thread and returns once it has run. On that thread it runs
+// directly, because a queued functor would only get its turn after we return.
+// Returns false without running cb if the loop quits first: its thread is going
+// away and nothing else may touch the channels it owns.
+bool runInLoopAndWait(EventLoop* loop, std::function<void()> cb)
+{
+    if (loop->isInLoopThread())
+    {
+        cb();
+        return true;
+    }
+
+    // exactly one side claims cb: the loop to run it, or this thread to give up on it
+    std::shared_ptr<std::atomic<bool>> claimed = std::make_shared<std::atomic<bool>>(false);
+    std::shared_ptr<std::promise<void>> done = std::make_shared<std::promise<void>>();
+    std::future<void> ran = done->get_future();
+    loop->queueInLoop([claimed, done, cb]() {
+        if (!claimed->exchange(true))
+        {
+            cb();
+            done->set_value();
+        }
+    });
+
+    while (ran.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready)
+    {
+        if (loop->quitting() && !claimed->exchange(true))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace
+
+Server::Server(EventLoop* loop, int threadNum, int port, bool reusePort)
     : loop_(loop),
       threadNum_(threadNum),
+      port_(port),
+      reusePort_(reusePort),
       threadPool_(std::make_unique<EventLoopThreadPool>(loop, threadNum)),
-      acceptor_(std::make_unique<Acceptor>(loop, port)),
+      highWaterMark_(0),
       started_(false),
       nextConnId_(1)
 {
-    acceptor_->setNewConnectionCallback(std::bind(&Server::newConnection, this, std::placeholders::_1, std::placeholders::_2));
+    // In reusePort mode the listening sockets are opened in start(), once the I/O loops exist.
+    // A socket opened here would join the SO_REUSEPORT group and take a share of connections.
+    if (!reusePort_)
+    {
+        acceptor_ = std::make_unique<Acceptor>(loop, port);
+        acceptor_->setNewConnectionCallback(std::bind(&Server::newConnection, this, std::placeholders::_1, std::placeholders::_2));
+    }
     handle_for_sigpipe();
 }
 
 Server::~Server()
 {
-    for (auto& item : connections_)
+    // Acceptor channels must be removed from their own loop, wait until each one is gone.
+    // An acceptor whose loop has already quit is left alone, its channel dies with the loop.
+    for (Acceptor* acceptor : loopAcceptors_)
+    {
+        runInLoopAndWait(acceptor->getLoop(), [acceptor]() { delete acceptor; });
+    }
+
+    // Each loop tears down its own connections; wait so none outlives the Server. Those of
+    // a loop that has already quit are only released with the registry
+    for (auto& item : registries_)
     {
-        std::shared_ptr<TcpConnection> conn(item.second);
-        item.second.reset();
-        conn->getLoop()->runInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+        ConnectionRegistry* registry = item.second.get();
+        runInLoopAndWait(registry->getLoop(), [registry]() {
+            for (const std::shared_ptr<TcpConnection>& conn : registry->takeAll())
+            {
+                registry->getLoop()->adjustAssignedConnections(-1);
+                conn->connectDestroyed();
+            }
+        });
     }
 }
 
@@ -31,41 +92,97 @@ void Server::start()
     {
         started_ = true;
         threadPool_->start();
-        loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        for (EventLoop* ioLoop : threadPool_->getAllLoops())
+        {
+            registries_[ioLoop] = std::make_unique<ConnectionRegistry>(ioLoop);
+        }
+        if (reusePort_)
+        {
+            for (EventLoop* ioLoop : threadPool_->getAllLoops())
+            {
+                Acceptor* acceptor = new Acceptor(ioLoop, port_, true);
+                acceptor->setNewConnectionCallback(std::bind(&Server::newConnectionInLoop, this, ioLoop, std::placeholders::_1, std::placeholders::_2));
+                int cpu = threadPool_->pinnedCpu(ioLoop);
+                if (cpu >= 0)
+                {
+                    acceptor->setIncomingCpu(cpu);
+                }
+                loopAcceptors_.push_back(acceptor);
+                ioLoop->runInLoop(std::bind(&Acceptor::listen, acceptor));
+            }
+        }
+        else
+        {
+            loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        }
+    }
+}
+
+size_t Server::connectionCount() const
+{
+    size_t count = 0;
+    for (const auto& item : registries_)
+    {
+        count += item.second->size();
+    }
+    return count;
+}
+
+void Server::forEachConnection(const ConnectionRegistry::Visitor& visitor)
+{
+    for (auto& item : registries_)
+    {
+        ConnectionRegistry* registry = item.second.get();
+        registry->getLoop()->runInLoop([registry, visitor]() { registry->forEach(visitor); });
     }
 }
 
 void Server::newConnection(int sockfd, const InetAddress& peerAddr)
 {
     loop_->assertInLoopThread();
-    EventLoop* ioLoop = threadPool_->getNextLoop();
-    
-    std::string connName = "Connection-" + std::to_string(nextConnId_++);
+    EventLoop* ioLoop = threadPool_->getLoopForConnection(sockfd, peerAddr);
+    // the connection is created in its own loop, which owns the pool it is allocated from
+    ioLoop->runInLoop([this, ioLoop, sockfd, peerAddr]() { establishConnection(ioLoop, sockfd, peerAddr); });
+}
+
+void Server::newConnectionInLoop(EventLoop* ioLoop, int sockfd, const InetAddress& peerAddr)
+{
+    // reusePort: accepted on the loop that serves the connection, no hand-off needed
+    ioLoop->assertInLoopThread();
+    ioLoop->adjustAssignedConnections(1);
+    establishConnection(ioLoop, sockfd, peerAddr);
+}
+
+void Server::establishConnection(EventLoop* ioLoop, int sockfd, const InetAddress& peerAddr)
+{
+    ioLoop->assertInLoopThread();
+    uint64_t connId = nextConnId_++;
     
-    // LOG_INFO << "Server::newConnection [" << connName << "] - new connection";
+    // LOG_INFO << "Server::newConnection [Connection-" << connId << "] - new connection";
     setSocketNodelay(sockfd);
     
-    std::shared_ptr<TcpConnection> conn = std::make_shared<TcpConnection>(ioLoop, connName, sockfd);
-    connections_[connName] = conn;
+    std::shared_ptr<TcpConnection> conn = TcpConnection::create(ioLoop, connId, sockfd, peerAddr);
     
     conn->setConnectionCallback(connectionCallback_);
     conn->setMessageCallback(messageCallback_);
-    conn->setCloseCallback(std::bind(&Server::removeConnection, this, std::placeholders::_1));
-    
-    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
-}
+    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    if (highWaterMarkCallback_)
+    {
+        conn->setHighWaterMarkCallback(highWaterMarkCallback_, highWaterMark_);
+    }
+    ConnectionRegistry* registry = registries_.at(ioLoop).get();
+    conn->setCloseCallback([this, registry](const std::shared_ptr<TcpConnection>& conn) { removeConnection(registry, conn); });
+    conn->setTimeouts(timeouts_);
 
-void Server::removeConnection(const std::shared_ptr<TcpConnection>& conn)
-{
-    loop_->runInLoop(std::bind(&Server::removeConnectionInLoop, this, conn));
+    // registered in the loop that serves it, so closing never leaves that loop
+    registry->add(conn);
+    conn->connectEstablished();
 }
 
-void Server::removeConnectionInLoop(const std::shared_ptr<TcpConnection>& conn)
+void Server::removeConnection(ConnectionRegistry* registry, const std::shared_ptr<TcpConnection>& conn)
 {
-    loop_->assertInLoopThread();
-    size_t n = connections_.erase(conn->name());
-    (void)n;
-    
-    EventLoop* ioLoop = conn->getLoop();
-    ioLoop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    registry->remove(conn);
+    registry->getLoop()->adjustAssignedConnections(-1);
+    // queued, the channel is still handling the event that closed the connection
+    conn->getLoop()->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
 }
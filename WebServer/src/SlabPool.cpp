@@ -0,0 +1,158 @@
+#include "SlabPool.h"
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstdio>
+
+SlabPool::SlabPool(int numaNode)
+    : owner_(std::this_thread::get_id()),
+      numaNode_(numaNode),
+      freeLists_(),
+      remoteFree_(nullptr),
+      chunkCursor_(nullptr),
+      chunkEnd_(nullptr)
+{
+}
+
+SlabPool::~SlabPool()
+{
+    for (char* chunk : chunks_)
+    {
+        if (numaNode_ >= 0)
+        {
+            munmap(chunk, kChunkSize);
+        }
+        else
+        {
+            ::operator delete(chunk);
+        }
+    }
+    for (void* block : foreignBlocks_)
+    {
+        ::operator delete(block);
+    }
+}
+
+void* SlabPool::allocate(size_t size)
+{
+    if (size == 0 || size > kMaxBlock)
+    {
+        return ::operator new(size);
+    }
+
+    size_t cls = sizeClass(size);
+    if (std::this_thread::get_id() != owner_)
+    {
+        return allocateForeign(cls);
+    }
+    if (!freeLists_[cls])
+    {
+        reclaimRemote();
+    }
+    FreeBlock* block = freeLists_[cls];
+    if (block)
+    {
+        freeLists_[cls] = block->next;
+        return block;
+    }
+    return carve(cls);
+}
+
+void SlabPool::deallocate(void* p, size_t size)
+{
+    if (size == 0 || size > kMaxBlock)
+    {
+        ::operator delete(p);
+        return;
+    }
+
+    size_t cls = sizeClass(size);
+    FreeBlock* block = static_cast<FreeBlock*>(p);
+    if (std::this_thread::get_id() == owner_)
+    {
+        block->next = freeLists_[cls];
+        freeLists_[cls] = block;
+        return;
+    }
+
+    // Push-only from foreign threads and the owner takes the whole list at once, so the
+    // stack has no ABA problem
+    block->sizeClass = cls;
+    block->next = remoteFree_.load(std::memory_order_relaxed);
+    while (!remoteFree_.compare_exchange_weak(block->next, block, std::memory_order_release, std::memory_order_relaxed))
+    {
+    }
+}
+
+void* SlabPool::carve(size_t sizeClass)
+{
+    size_t blockSize = (sizeClass + 1) * kGranularity;
+    if (static_cast<size_t>(chunkEnd_ - chunkCursor_) < blockSize)
+    {
+        // Blocks and chunks are multiples of kGranularity, so the tail of the old chunk is
+        // an exact block of a smaller class
+        size_t tail = chunkEnd_ - chunkCursor_;
+        if (tail > 0)
+        {
+            FreeBlock* block = reinterpret_cast<FreeBlock*>(chunkCursor_);
+            block->next = freeLists_[SlabPool::sizeClass(tail)];
+            freeLists_[SlabPool::sizeClass(tail)] = block;
+        }
+        char* chunk = newChunk();
+        chunks_.push_back(chunk);
+        chunkCursor_ = chunk;
+        chunkEnd_ = chunk + kChunkSize;
+    }
+    void* block = chunkCursor_;
+    chunkCursor_ += blockSize;
+    return block;
+}
+
+void* SlabPool::allocateForeign(size_t sizeClass)
+{
+    // The free lists are the owner's alone. A full block of the class can join them once it
+    // is freed, so it is only remembered here to be released with the chunks
+    void* block = ::operator new((sizeClass + 1) * kGranularity);
+    std::lock_guard<std::mutex> lock(foreignMutex_);
+    foreignBlocks_.push_back(block);
+    return block;
+}
+
+char* SlabPool::newChunk()
+{
+    if (numaNode_ < 0)
+    {
+        return static_cast<char*>(::operator new(kChunkSize));
+    }
+
+    void* chunk = mmap(nullptr, kChunkSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (chunk == MAP_FAILED)
+    {
+        throw std::bad_alloc();
+    }
+    // Preferred rather than bound: a full node falls back to another one instead of failing.
+    // Called without libnuma, which only wraps this syscall.
+    unsigned long nodeMask[4] = {};
+    if (numaNode_ < static_cast<int>(sizeof nodeMask * 8))
+    {
+        nodeMask[numaNode_ / 64] = 1UL << (numaNode_ % 64);
+        if (syscall(SYS_mbind, chunk, kChunkSize, MPOL_PREFERRED, nodeMask, sizeof nodeMask * 8, 0) < 0)
+        {
+            perror("SlabPool mbind");
+        }
+    }
+    return static_cast<char*>(chunk);
+}
+
+void SlabPool::reclaimRemote()
+{
+    FreeBlock* block = remoteFree_.exchange(nullptr, std::memory_order_acquire);
+    while (block)
+    {
+        FreeBlock* next = block->next;
+        block->next = freeLists_[block->sizeClass];
+        freeLists_[block->sizeClass] = block;
+        block = next;
+    }
+}
@@ -1,19 +1,35 @@
 #include "TcpConnection.h"
-#include "Channel.h"
 #include <unistd.h>
+#include <sys/socket.h>
+#include <algorithm>
 #include <iostream>
 
-TcpConnection::TcpConnection(EventLoop* loop, const std::string& name, int sockfd)
+TcpConnection::TcpConnection(EventLoop* loop, uint64_t id, int sockfd, const InetAddress& peerAddr)
     : loop_(loop),
-      name_(name),
+      id_(id),
+      registryIndex_(0),
       fd_(sockfd),
       state_(kConnecting),
-      channel_(std::make_unique<Channel>(loop, sockfd))
+      channel_(loop, sockfd),
+      peerAddr_(peerAddr),
+      localAddrResolved_(false),
+      inputBuffer_(Buffer::kInitialSize, Buffer::Allocator(loop->pool())),
+      outputQueue_(PoolAllocator<char>(loop->pool())),
+      timeout_(kNoTimeout),
+      timeoutEntry_([this]() { handleTimeout(); }),
+      highWaterMark_(64 * 1024 * 1024)
 {
-    channel_->setReadCallback(std::bind(&TcpConnection::handleRead, this));
-    channel_->setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
-    channel_->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
-    channel_->setErrorCallback(std::bind(&TcpConnection::handleError, this));
+    // lambdas capturing only this fit in std::function's inline storage, std::bind does not
+    channel_.setReadCallback([this]() { handleRead(); });
+    channel_.setWriteCallback([this]() { handleWrite(); });
+    channel_.setCloseCallback([this]() { handleClose(); });
+    channel_.setErrorCallback([this]() { handleError(); });
+}
+
+std::shared_ptr<TcpConnection> TcpConnection::create(EventLoop* loop, uint64_t id, int sockfd, const InetAddress& peerAddr)
+{
+    loop->assertInLoopThread();
+    return std::allocate_shared<TcpConnection>(PoolAllocator<TcpConnection>(loop->pool()), loop, id, sockfd, peerAddr);
 }
 
 TcpConnection::~TcpConnection()
@@ -25,12 +41,32 @@ TcpConnection::~TcpConnection()
     }
 }
 
+const InetAddress& TcpConnection::localAddress()
+{
+    if (!localAddrResolved_)
+    {
+        struct sockaddr_in6 addr;
+        socklen_t addrLen = sizeof addr;
+        if (getsockname(fd_, (struct sockaddr*)&addr, &addrLen) == 0)
+        {
+            localAddr_ = InetAddress((struct sockaddr*)&addr);
+            localAddrResolved_ = true;
+        }
+        else
+        {
+            perror("TcpConnection::localAddress");
+        }
+    }
+    return localAddr_;
+}
+
 void TcpConnection::connectEstablished()
 {
     loop_->assertInLoopThread();
     state_ = kConnected;
-    channel_->tie(shared_from_this());
-    channel_->enableReading();
+    channel_.tie(shared_from_this());
+    channel_.enableReading();
+    updateTimeout();
     
     if (connectionCallback_)
     {
@@ -44,18 +80,26 @@ void TcpConnection::connectDestroyed()
     if (state_ == kConnected)
     {
         state_ = kDisconnected;
-        channel_->disableAll();
+        channel_.disableAll();
         
         if (connectionCallback_)
         {
             connectionCallback_(shared_from_this());
         }
     }
-    channel_->remove(); // Need to ensure Channel has remove()
+    // the last reference may be dropped in another thread, leave the wheel while still in the loop
+    loop_->timingWheel()->cancel(&timeoutEntry_);
+    channel_.remove(); // Need to ensure Channel has remove()
 }
 
 void TcpConnection::handleRead()
 {
+    if (receiver_)
+    {
+        handleReceive();
+        return;
+    }
+
     int savedErrno = 0;
     ssize_t n = inputBuffer_.readFd(fd_, &savedErrno);
     
@@ -65,47 +109,156 @@ void TcpConnection::handleRead()
         {
             messageCallback_(shared_from_this(), &inputBuffer_);
         }
+        updateTimeout();
+    }
+    else if (n == 0)
+    {
+        handleClose();
+    }
+    else
+    {
+        errno = savedErrno;
+        handleError();
+    }
+}
+
+void TcpConnection::receiveToFile(const std::shared_ptr<const OpenFile>& file, off_t offset, size_t len, const ReceiveCompleteCallback& cb)
+{
+    loop_->assertInLoopThread();
+    receiver_ = std::make_unique<FileReceiver>(file, offset, len);
+    receiveCompleteCallback_ = cb;
+
+    size_t buffered = std::min(len, inputBuffer_.readableBytes());
+    bool ok = receiver_->write(inputBuffer_.peek(), buffered);
+    inputBuffer_.retrieve(buffered);
+    if (!ok || receiver_->done())
+    {
+        finishReceive(ok);
+    }
+}
+
+void TcpConnection::handleReceive()
+{
+    int savedErrno = 0;
+    ssize_t n = receiver_->receive(fd_, &savedErrno);
+    if (n > 0 || (n < 0 && savedErrno == EAGAIN))
+    {
+        if (receiver_->done())
+        {
+            finishReceive(true);
+        }
+        updateTimeout();
     }
     else if (n == 0)
     {
+        finishReceive(false);
         handleClose();
     }
     else
     {
+        finishReceive(false);
         errno = savedErrno;
         handleError();
     }
 }
 
+void TcpConnection::finishReceive(bool ok)
+{
+    size_t received = receiver_->received();
+    receiver_.reset(); // back to reading into inputBuffer_
+    ReceiveCompleteCallback cb;
+    cb.swap(receiveCompleteCallback_);
+    if (cb)
+    {
+        cb(shared_from_this(), received, ok);
+    }
+}
+
 void TcpConnection::handleWrite()
 {
-    if (channel_->isWriting())
+    if (channel_.isWriting())
     {
-        ssize_t n = write(fd_, outputBuffer_.peek(), outputBuffer_.readableBytes());
-        if (n > 0)
+        int savedErrno = 0;
+        ssize_t n = outputQueue_.writeFd(fd_, &savedErrno);
+        if (n < 0)
         {
-            outputBuffer_.retrieve(n);
-            if (outputBuffer_.readableBytes() == 0)
+            if (savedErrno != EAGAIN && savedErrno != EWOULDBLOCK)
             {
-                channel_->disableWriting();
-                // TODO: writeCompleteCallback
-                if (state_ == kDisconnecting)
-                {
-                    shutdownInLoop();
-                }
+                // the rest of the response can no longer be delivered intact
+                errno = savedErrno;
+                perror("TcpConnection::handleWrite");
+                forceCloseInLoop();
             }
+            return;
         }
-        else
+        if (outputQueue_.empty())
+        {
+            channel_.disableWriting();
+            queueWriteComplete();
+            if (state_ == kDisconnecting)
+            {
+                shutdownInLoop();
+            }
+        }
+        if (n > 0)
         {
-            perror("TcpConnection::handleWrite");
+            updateTimeout(true);
         }
     }
 }
 
+void TcpConnection::updateTimeout(bool wrote)
+{
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+
+    TimeoutE next = kIdleTimeout;
+    TimingWheel::Duration timeout = timeouts_.idle;
+    if (!outputQueue_.empty())
+    {
+        next = kWriteTimeout;
+        timeout = timeouts_.write;
+    }
+    else if (inputBuffer_.readableBytes() > 0 && !receiver_)
+    {
+        next = kHeaderTimeout;
+        timeout = timeouts_.header;
+    }
+
+    // Only the idle timeout restarts on every event: a trickling client must not extend
+    // its header deadline, and a write stall only ends when the peer takes some output
+    if (next == timeout_ && (next == kHeaderTimeout || (next == kWriteTimeout && !wrote)))
+    {
+        return;
+    }
+    timeout_ = next;
+    if (timeout.count() > 0)
+    {
+        loop_->timingWheel()->schedule(&timeoutEntry_, timeout);
+    }
+    else
+    {
+        loop_->timingWheel()->cancel(&timeoutEntry_);
+    }
+}
+
+void TcpConnection::handleTimeout()
+{
+    // the entry is a member, so the connection is alive while its callback runs
+    forceCloseInLoop();
+}
+
 void TcpConnection::handleClose()
 {
     state_ = kDisconnected;
-    channel_->disableAll();
+    channel_.disableAll();
+    loop_->timingWheel()->cancel(&timeoutEntry_);
+    if (receiver_)
+    {
+        finishReceive(false);
+    }
     
     std::shared_ptr<TcpConnection> guardThis(shared_from_this());
     if (connectionCallback_)
@@ -124,7 +277,7 @@ void TcpConnection::handleError()
     int err = 0;
     socklen_t len = sizeof err;
     getsockopt(fd_, SOL_SOCKET, SO_ERROR, &err, &len);
-    // LOG_ERROR << "TcpConnection::handleError [" << name_ << "] - SO_ERROR = " << err << " " << strerror_tl(err);
+    // LOG_ERROR << "TcpConnection::handleError [" << name() << "] - SO_ERROR = " << err << " " << strerror_tl(err);
 }
 
 void TcpConnection::send(const std::string& message)
@@ -160,6 +313,50 @@ void TcpConnection::send(Buffer* message)
     }
 }
 
+void TcpConnection::send(std::string&& message)
+{
+    send(std::move(message), nullptr);
+}
+
+void TcpConnection::send(const OutputQueue::Blob& blob)
+{
+    send(std::string(), blob);
+}
+
+void TcpConnection::send(std::string&& header, const OutputQueue::Blob& body)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendInLoop(std::move(header), body);
+        }
+        else
+        {
+            loop_->runInLoop([self = shared_from_this(), header = std::move(header), body]() mutable {
+                self->sendInLoop(std::move(header), body);
+            });
+        }
+    }
+}
+
+void TcpConnection::sendFile(std::string&& header, const OutputQueue::File& file, off_t offset, size_t len)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendFileInLoop(std::move(header), file, offset, len);
+        }
+        else
+        {
+            loop_->runInLoop([self = shared_from_this(), header = std::move(header), file, offset, len]() mutable {
+                self->sendFileInLoop(std::move(header), file, offset, len);
+            });
+        }
+    }
+}
+
 void TcpConnection::sendInLoop(const std::string& message)
 {
     sendInLoop(message.data(), message.size());
@@ -170,11 +367,12 @@ void TcpConnection::sendInLoop(const char* data, size_t len)
     ssize_t nwrote = 0;
     size_t remaining = len;
     bool faultError = false;
+    size_t pendingBefore = outputQueue_.readableBytes();
 
     if (state_ == kDisconnected) return;
 
     // if no thing in output queue, try to write directly
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    if (!channel_.isWriting() && outputQueue_.empty())
     {
         nwrote = write(fd_, data, len);
         if (nwrote >= 0)
@@ -182,7 +380,7 @@ void TcpConnection::sendInLoop(const char* data, size_t len)
             remaining = len - nwrote;
             if (remaining == 0) // complete
             {
-                // TODO: writeCompleteCallback
+                queueWriteComplete();
             }
         }
         else
@@ -201,11 +399,88 @@ void TcpConnection::sendInLoop(const char* data, size_t len)
 
     if (!faultError && remaining > 0)
     {
-        outputBuffer_.append(data + nwrote, remaining);
-        if (!channel_->isWriting())
+        outputQueue_.append(data + nwrote, remaining);
+        if (!channel_.isWriting())
+        {
+            channel_.enableWriting();
+        }
+    }
+    updateTimeout(nwrote > 0);
+    checkHighWaterMark(pendingBefore);
+}
+
+void TcpConnection::sendInLoop(std::string&& header, const OutputQueue::Blob& body)
+{
+    if (state_ == kDisconnected) return;
+
+    size_t pendingBefore = outputQueue_.readableBytes();
+    outputQueue_.append(std::move(header));
+    outputQueue_.append(body);
+    flushOutputInLoop();
+    checkHighWaterMark(pendingBefore);
+}
+
+void TcpConnection::sendFileInLoop(std::string&& header, const OutputQueue::File& file, off_t offset, size_t len)
+{
+    if (state_ == kDisconnected) return;
+
+    size_t pendingBefore = outputQueue_.readableBytes();
+    outputQueue_.append(std::move(header));
+    outputQueue_.appendFile(file, offset, len);
+    flushOutputInLoop();
+    checkHighWaterMark(pendingBefore);
+}
+
+void TcpConnection::flushOutputInLoop()
+{
+    // if nothing was pending, write the queued segments right away
+    if (!channel_.isWriting())
+    {
+        int savedErrno = 0;
+        ssize_t nwrote = outputQueue_.writeFd(fd_, &savedErrno);
+        if (nwrote < 0 && savedErrno != EAGAIN && savedErrno != EWOULDBLOCK)
         {
-            channel_->enableWriting();
+            errno = savedErrno;
+            perror("TcpConnection::flushOutputInLoop");
+            forceCloseInLoop();
+            return;
         }
+        if (!outputQueue_.empty())
+        {
+            channel_.enableWriting();
+        }
+        else
+        {
+            queueWriteComplete();
+        }
+        updateTimeout(nwrote > 0);
+    }
+}
+
+void TcpConnection::checkHighWaterMark(size_t pendingBefore)
+{
+    // Fires on crossing the mark, not on every send while above it. Called right away so
+    // a producer sending in a loop can stop before queueing more; the send is complete here
+    size_t pending = outputQueue_.readableBytes();
+    if (highWaterMarkCallback_ && pendingBefore < highWaterMark_ && pending >= highWaterMark_)
+    {
+        highWaterMarkCallback_(shared_from_this(), pending);
+    }
+}
+
+void TcpConnection::queueWriteComplete()
+{
+    // Queued rather than called, so a callback that sends more does not recurse into the
+    // send path. Output sent in the meantime makes the notification stale; the one raised
+    // when that output drains takes its place.
+    if (writeCompleteCallback_)
+    {
+        loop_->queueInLoop([self = shared_from_this()]() {
+            if (self->outputQueue_.empty() && self->writeCompleteCallback_)
+            {
+                self->writeCompleteCallback_(self);
+            }
+        });
     }
 }
 
@@ -220,7 +495,7 @@ void TcpConnection::shutdown()
 
 void TcpConnection::shutdownInLoop()
 {
-    if (!channel_->isWriting())
+    if (!channel_.isWriting())
     {
         ::shutdown(fd_, SHUT_WR);
     }
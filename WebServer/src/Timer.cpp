@@ -8,6 +8,8 @@
 using namespace std;
 using namespace std::chrono;
 
+std::atomic<int64_t> TimerNode::numCreated_(0);
+
 int createTimerfd()
 {
     int timerfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
@@ -18,7 +20,7 @@ int createTimerfd()
     return timerfd;
 }
 
-void readTimerfd(int timerfd, TimerNode::Timestamp now)
+void readTimerfd(int timerfd, [[maybe_unused]] TimerNode::Timestamp now)
 {
     uint64_t howmany;
     ssize_t n = ::read(timerfd, &howmany, sizeof howmany);
@@ -68,10 +70,63 @@ TimerManager::~TimerManager()
     }
 }
 
-void TimerManager::addTimer(TimerCallback cb, Timestamp when, double interval)
+TimerId TimerManager::addTimer(TimerCallback cb, Timestamp when, double interval)
 {
     TimerNode* timer = new TimerNode(cb, when, interval);
     loop_->runInLoop(std::bind(&TimerManager::insert, this, timer));
+    return TimerId(timer, timer->sequence());
+}
+
+void TimerManager::cancel(TimerId timerId)
+{
+    loop_->runInLoop(std::bind(&TimerManager::cancelInLoop, this, timerId));
+}
+
+void TimerManager::restart(TimerId timerId, Timestamp when)
+{
+    loop_->runInLoop(std::bind(&TimerManager::restartInLoop, this, timerId, when));
+}
+
+void TimerManager::cancelInLoop(TimerId timerId)
+{
+    ActiveTimer timer(timerId.timer_, timerId.sequence_);
+    if (activeTimers_.find(timer) == activeTimers_.end())
+    {
+        return; // already ran or cancelled
+    }
+    // A live timer is either pending in timers_ or part of the batch handleRead() is running
+    if (timers_.erase(Entry(timer.first->expiration(), timer.first)) > 0)
+    {
+        activeTimers_.erase(timer);
+        delete timer.first;
+    }
+    else
+    {
+        cancelingTimers_.insert(timer);
+    }
+}
+
+void TimerManager::restartInLoop(TimerId timerId, Timestamp when)
+{
+    ActiveTimer timer(timerId.timer_, timerId.sequence_);
+    if (activeTimers_.find(timer) == activeTimers_.end())
+    {
+        return;
+    }
+    if (timers_.erase(Entry(timer.first->expiration(), timer.first)) > 0)
+    {
+        timer.first->setExpiration(when);
+        if (!insert(timer.first) && !timers_.empty())
+        {
+            // the earliest timer may have been the one that moved later
+            resetTimerfd(timerfd_, timers_.begin()->first);
+        }
+    }
+    else
+    {
+        timer.first->setExpiration(when);
+        restartingTimers_.insert(timer);
+    }
 }
 
 bool TimerManager::insert(TimerNode* timer)
@@ -84,6 +139,7 @@ bool TimerManager::insert(TimerNode* timer)
         earliestChanged = true;
     }
     timers_.insert(Entry(when, timer));
+    activeTimers_.insert(ActiveTimer(timer, timer->sequence()));
 
     if (earliestChanged)
     {
@@ -101,10 +157,17 @@ void TimerManager::handleRead()
 
     for (const auto& entry : expired)
     {
-        entry.second->run();
+        // an earlier callback of this batch may have cancelled or postponed it
+        ActiveTimer timer(entry.second, entry.second->sequence());
+        if (cancelingTimers_.count(timer) == 0 && restartingTimers_.count(timer) == 0)
+        {
+            entry.second->run();
+        }
     }
 
     reset(expired, now);
+    cancelingTimers_.clear();
+    restartingTimers_.clear();
 }
 
 std::vector<TimerManager::Entry> TimerManager::getExpired(Timestamp now)
@@ -123,13 +186,24 @@ void TimerManager::reset(const std::vector<Entry>& expired, Timestamp now)
 
     for (const auto& entry : expired)
     {
-        if (entry.second->repeat())
+        ActiveTimer timer(entry.second, entry.second->sequence());
+        if (cancelingTimers_.count(timer) > 0)
+        {
+            activeTimers_.erase(timer);
+            delete entry.second;
+        }
+        else if (restartingTimers_.count(timer) > 0)
+        {
+            insert(entry.second); // expiration was already set by restartInLoop()
+        }
+        else if (entry.second->repeat())
         {
             entry.second->restart(now);
             insert(entry.second);
         }
         else
         {
+            activeTimers_.erase(timer);
             delete entry.second;
         }
     }
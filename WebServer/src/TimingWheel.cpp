@@ -0,0 +1,256 @@
+#include "TimingWheel.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+TimingWheel::Entry::~Entry()
+{
+    if (wheel_)
+    {
+        wheel_->cancel(this);
+    }
+}
+
+TimingWheel::TimingWheel(EventLoop* loop, Duration tick)
+    : loop_(loop),
+      tick_(tick),
+      start_(std::chrono::steady_clock::now()),
+      current_(0),
+      size_(0),
+      timerfd_(::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+      armed_(false)
+{
+    if (timerfd_ < 0)
+    {
+        perror("TimingWheel timerfd_create");
+        abort();
+    }
+    timerfdChannel_ = std::make_unique<Channel>(loop, timerfd_);
+    timerfdChannel_->setReadCallback(std::bind(&TimingWheel::handleRead, this));
+    timerfdChannel_->enableReading();
+}
+
+TimingWheel::~TimingWheel()
+{
+    // Pending entries outlive the wheel as unscheduled
+    for (Slot& slot : root_)
+    {
+        while (slot.head.next_ != &slot.head)
+        {
+            unlink(slot.head.next_);
+        }
+    }
+    for (auto& level : levels_)
+    {
+        for (Slot& slot : level)
+        {
+            while (slot.head.next_ != &slot.head)
+            {
+                unlink(slot.head.next_);
+            }
+        }
+    }
+    timerfdChannel_->disableAll();
+    timerfdChannel_->remove();
+    ::close(timerfd_);
+}
+
+void TimingWheel::link(Entry* head, Entry* entry)
+{
+    entry->prev_ = head->prev_;
+    entry->next_ = head;
+    head->prev_->next_ = entry;
+    head->prev_ = entry;
+}
+
+void TimingWheel::unlink(Entry* entry)
+{
+    entry->prev_->next_ = entry->next_;
+    entry->next_->prev_ = entry->prev_;
+    entry->prev_ = entry->next_ = nullptr;
+    entry->wheel_ = nullptr;
+}
+
+void TimingWheel::schedule(Entry* entry, Duration timeout)
+{
+    loop_->assertInLoopThread();
+    // Count from the present rather than from current_, which lags behind while the loop
+    // is busy; the tick in progress counts as passed, so a timeout never fires early
+    uint64_t now = elapsedTicks() + 1;
+    if (size_ == 0)
+    {
+        current_ = std::max(current_, now); // nothing pending, the idle wheel jumps ahead
+    }
+
+    uint64_t ticks = (timeout.count() + tick_.count() - 1) / tick_.count();
+    uint64_t expires = std::max(now, current_) + std::max<uint64_t>(ticks, 1);
+    expires = std::min(expires, current_ + kMaxTicks);
+
+    if (entry->wheel_)
+    {
+        if (entry->expires_ == expires)
+        {
+            return; // refreshed within the same tick
+        }
+        unlink(entry);
+        --size_;
+    }
+    entry->expires_ = expires;
+    entry->wheel_ = this;
+    place(entry);
+    if (++size_ == 1)
+    {
+        arm(true);
+    }
+}
+
+void TimingWheel::cancel(Entry* entry)
+{
+    assert(entry->wheel_ == nullptr || entry->wheel_ == this);
+    if (entry->wheel_)
+    {
+        unlink(entry);
+        if (--size_ == 0)
+        {
+            arm(false);
+        }
+    }
+}
+
+void TimingWheel::place(Entry* entry)
+{
+    uint64_t expires = entry->expires_;
+    uint64_t delta = expires > current_ ? expires - current_ : 0;
+    Entry* head;
+    if (delta < kRootSize)
+    {
+        head = &root_[(delta == 0 ? current_ : expires) & (kRootSize - 1)].head;
+    }
+    else
+    {
+        int level = 0;
+        while (level < kLevels - 2 && delta >= (uint64_t(1) << (kRootBits + (level + 1) * kLevelBits)))
+        {
+            ++level;
+        }
+        uint64_t index = (expires >> (kRootBits + level * kLevelBits)) & (kLevelSize - 1);
+        head = &levels_[level][index].head;
+    }
+    link(head, entry);
+}
+
+uint64_t TimingWheel::cascade(int level, uint64_t index)
+{
+    // Re-place every entry of the slot; they now land on an inner level
+    Entry& head = levels_[level][index].head;
+    Entry work;
+    work.prev_ = work.next_ = &work;
+    if (head.next_ != &head)
+    {
+        work.next_ = head.next_;
+        work.prev_ = head.prev_;
+        work.next_->prev_ = &work;
+        work.prev_->next_ = &work;
+        head.prev_ = head.next_ = &head;
+    }
+    while (work.next_ != &work)
+    {
+        Entry* entry = work.next_;
+        TimingWheel* wheel = entry->wheel_;
+        unlink(entry);
+        entry->wheel_ = wheel;
+        place(entry);
+    }
+    return index;
+}
+
+void TimingWheel::step()
+{
+    uint64_t index = current_ & (kRootSize - 1);
+    if (index == 0)
+    {
+        // The root wrapped around: pull the next slot of each outer level inward, as far
+        // out as the wrap-around carries
+        for (int level = 0; level < kLevels - 1; ++level)
+        {
+            uint64_t outer = (current_ >> (kRootBits + level * kLevelBits)) & (kLevelSize - 1);
+            if (cascade(level, outer) != 0)
+            {
+                break;
+            }
+        }
+    }
+
+    // Detach the due slot first: callbacks may schedule, cancel or destroy any entry
+    Entry& head = root_[index].head;
+    Entry work;
+    work.prev_ = work.next_ = &work;
+    if (head.next_ != &head)
+    {
+        work.next_ = head.next_;
+        work.prev_ = head.prev_;
+        work.next_->prev_ = &work;
+        work.prev_->next_ = &work;
+        head.prev_ = head.next_ = &head;
+    }
+    ++current_;
+
+    while (work.next_ != &work)
+    {
+        Entry* entry = work.next_;
+        unlink(entry);
+        --size_;
+        if (entry->callback_)
+        {
+            entry->callback_();
+        }
+    }
+}
+
+uint64_t TimingWheel::elapsedTicks() const
+{
+    return std::chrono::duration_cast<Duration>(std::chrono::steady_clock::now() - start_).count() / tick_.count();
+}
+
+void TimingWheel::handleRead()
+{
+    uint64_t howmany;
+    if (::read(timerfd_, &howmany, sizeof howmany) != sizeof howmany)
+    {
+        return;
+    }
+    // Catch up on every tick that passed, also when the loop was held up for several
+    uint64_t now = elapsedTicks();
+    while (current_ <= now && size_ > 0)
+    {
+        step();
+    }
+    if (size_ == 0)
+    {
+        arm(false);
+    }
+}
+
+void TimingWheel::arm(bool on)
+{
+    if (on == armed_)
+    {
+        return;
+    }
+    struct itimerspec value;
+    std::memset(&value, 0, sizeof value);
+    if (on)
+    {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(tick_).count();
+        value.it_interval.tv_sec = ns / 1000000000;
+        value.it_interval.tv_nsec = ns % 1000000000;
+        value.it_value = value.it_interval;
+    }
+    ::timerfd_settime(timerfd_, 0, &value, nullptr);
+    armed_ = on;
+}
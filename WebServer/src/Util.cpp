@@ -1,5 +1,6 @@
 #include "Util.h"
 
+#include <ctype.h>
 #include <fcntl.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
@@ -142,7 +143,7 @@ ssize_t writen(int fd, std::string& sbuff)
         remain -= writed;
         ptr += writed;
     }
-    if (write_sum == sbuff.size()) // write all
+    if (write_sum == static_cast<ssize_t>(sbuff.size())) // write all
     {
         sbuff.clear();
     }
@@ -216,7 +217,7 @@ void shutDownWR(int fd)
         return;
     }
 }
-int socket_bind_listen(int port)
+int socket_bind_listen(int port, bool reusePort)
 {
     if (port < 0 || port > 65535)
     {
@@ -236,6 +237,13 @@ int socket_bind_listen(int port)
         return -1;
     }
 
+    // let several listening sockets share the port, the kernel spreads incoming connections among them
+    if (reusePort && setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, (const char*)&opt, sizeof(opt)) < 0)
+    {
+        close(listenfd);
+        return -1;
+    }
+
     // set server ip and port
     struct sockaddr_in serveraddr;
     memset(&serveraddr, 0, sizeof(serveraddr));
@@ -254,4 +262,80 @@ int socket_bind_listen(int port)
         return -1;
     }
     return listenfd;
-}
\ No newline at end of file
+}
+
+std::string escapeHtml(std::string_view text)
+{
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (char c : text)
+    {
+        switch (c)
+        {
+        case '&':
+            escaped += "&amp;";
+            break;
+        case '<':
+            escaped += "&lt;";
+            break;
+        case '>':
+            escaped += "&gt;";
+            break;
+        case '"':
+            escaped += "&quot;";
+            break;
+        default:
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+std::string encodeUrlPath(std::string_view path)
+{
+    static const char kHex[] = "0123456789ABCDEF";
+    std::string encoded;
+    encoded.reserve(path.size());
+    for (char c : path)
+    {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (isalnum(u) || c == '-' || c == '_' || c == '.' || c == '~' || c == '/')
+        {
+            encoded += c;
+        }
+        else
+        {
+            encoded += '%';
+            encoded += kHex[u >> 4];
+            encoded += kHex[u & 0xF];
+        }
+    }
+    return encoded;
+}
+
+bool decodeUrlPath(std::string_view path, std::string& decoded)
+{
+    decoded.clear();
+    decoded.reserve(path.size());
+    for (size_t i = 0; i < path.size(); ++i)
+    {
+        if (path[i] != '%')
+        {
+            decoded += path[i];
+            continue;
+        }
+        if (i + 2 >= path.size() || !isxdigit(static_cast<unsigned char>(path[i + 1])) || !isxdigit(static_cast<unsigned char>(path[i + 2])))
+        {
+            return false;
+        }
+        auto hex = [](char h) { return isdigit(static_cast<unsigned char>(h)) ? h - '0' : tolower(static_cast<unsigned char>(h)) - 'a' + 10; };
+        char c = static_cast<char>(hex(path[i + 1]) * 16 + hex(path[i + 2]));
+        if (c == '\0')
+        {
+            return false;
+        }
+        decoded += c;
+        i += 2;
+    }
+    return true;
+}